@@ -12,9 +12,13 @@
 #include "PrivateTypes.h"
 #include "EntryPoints.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <atomic>
+#include <chrono>
+
 // gCall4D stores the address of a callback routine in 4D.
 // this address is given by 4D when it calls the plugin for the first time.
 Call4DProcPtr gCall4D = 0;
@@ -57,13 +61,143 @@ static PA_long32 sBinaryFormat = 'MACH';	// MachO only
 static PA_long32 sBinaryFormat = 0;	// CFM or Windows
 #endif
 
-static short sErrorCode = 0;
+// each thread sees the error of its own last call
+static thread_local short sErrorCode = 0;
+
+// selector in the high word, error in the low word, so an entry is
+// written with a single store and never read torn
+static std::atomic<PA_ulong32> sErrorHistory[PA_ERROR_HISTORY_SIZE];
+static std::atomic<PA_ulong32> sErrorHistoryCount(0);
 
 PA_ErrorCode PA_GetLastError()
 {
 	return (PA_ErrorCode) sErrorCode;
 }
 
+PA_long32 PA_GetErrorHistory( short* selectors, PA_ErrorCode* errors, PA_long32 count )
+{
+	PA_ulong32 last = sErrorHistoryCount.load( std::memory_order_acquire );
+	PA_long32 filled = 0;
+	
+	while ( ( filled < count ) && ( filled < PA_ERROR_HISTORY_SIZE ) && ( (PA_ulong32) filled < last ) )
+	{
+		PA_ulong32 entry = sErrorHistory[ ( last - 1 - filled ) % PA_ERROR_HISTORY_SIZE ].load( std::memory_order_relaxed );
+		selectors[ filled ] = (short) ( entry >> 16 );
+		errors[ filled ] = (PA_ErrorCode) (short) ( entry & 0xFFFF );
+		filled++;
+	}
+	
+	return filled;
+}
+
+// one entry per selector; selectors are small negative numbers, so
+// -selector is unique within the table for every selector 4D defines
+typedef struct PA_ProfileEntry
+{
+	std::atomic<short>		fSelector;
+	std::atomic<PA_ulong64>	fCount;
+	std::atomic<PA_ulong64>	fTotal;
+	std::atomic<PA_ulong64>	fMax;
+} PA_ProfileEntry;
+
+static std::atomic<bool> sProfiling(false);
+static PA_ProfileEntry sProfile[PA_PROFILE_SIZE];
+
+static PA_ulong64 MicrosecondClock()
+{
+	return (PA_ulong64) std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static void ProfileCall( short selector, PA_ulong64 duration )
+{
+	PA_ProfileEntry& entry = sProfile[ (unsigned short) -selector % PA_PROFILE_SIZE ];
+	entry.fSelector.store( selector, std::memory_order_relaxed );
+	entry.fTotal.fetch_add( duration, std::memory_order_relaxed );
+	PA_ulong64 max = entry.fMax.load( std::memory_order_relaxed );
+	while ( ( duration > max ) && !entry.fMax.compare_exchange_weak( max, duration, std::memory_order_relaxed ) ) {}
+	// published last, so a reader that sees the count sees the selector
+	entry.fCount.fetch_add( 1, std::memory_order_release );
+}
+
+void PA_EnableProfiling( char enable )
+{
+	if ( enable )
+	{
+		for ( PA_long32 i = 0; i < PA_PROFILE_SIZE; i++ )
+		{
+			sProfile[ i ].fCount.store( 0, std::memory_order_relaxed );
+			sProfile[ i ].fTotal.store( 0, std::memory_order_relaxed );
+			sProfile[ i ].fMax.store( 0, std::memory_order_relaxed );
+		}
+	}
+	sProfiling.store( enable != 0, std::memory_order_release );
+}
+
+char PA_IsProfiling()
+{
+	return sProfiling.load( std::memory_order_relaxed ) ? 1 : 0;
+}
+
+PA_long32 PA_GetProfile( short* selectors, PA_ulong64* counts, PA_ulong64* totals, PA_ulong64* maxima, PA_long32 count )
+{
+	PA_long32 filled = 0;
+	
+	for ( PA_long32 i = 0; ( i < PA_PROFILE_SIZE ) && ( filled < count ); i++ )
+	{
+		PA_ulong64 calls = sProfile[ i ].fCount.load( std::memory_order_acquire );
+		if ( calls == 0 )
+			continue;
+		selectors[ filled ] = sProfile[ i ].fSelector.load( std::memory_order_relaxed );
+		counts[ filled ] = calls;
+		totals[ filled ] = sProfile[ i ].fTotal.load( std::memory_order_relaxed );
+		maxima[ filled ] = sProfile[ i ].fMax.load( std::memory_order_relaxed );
+		filled++;
+	}
+	
+	return filled;
+}
+
+char PA_WriteProfile( FILE* file )
+{
+	fputs( "selector\tcount\ttotal_us\tmax_us\n", file );
+	for ( PA_long32 i = 0; i < PA_PROFILE_SIZE; i++ )
+	{
+		PA_ulong64 calls = sProfile[ i ].fCount.load( std::memory_order_acquire );
+		if ( calls == 0 )
+			continue;
+		fprintf( file, "%d\t%llu\t%llu\t%llu\n", (int) sProfile[ i ].fSelector.load( std::memory_order_relaxed ),
+				 (unsigned long long) calls,
+				 (unsigned long long) sProfile[ i ].fTotal.load( std::memory_order_relaxed ),
+				 (unsigned long long) sProfile[ i ].fMax.load( std::memory_order_relaxed ) );
+	}
+	
+	return ferror( file ) == 0;
+}
+
+void Call4DLogged( short selector, EngineBlock* eb )
+{
+	// fError is an output only, and most callers leave it uninitialised
+	eb->fError = 0;
+	
+	if ( sProfiling.load( std::memory_order_relaxed ) )
+	{
+		PA_ulong64 begin = MicrosecondClock();
+		(*gCall4D)( selector, eb );
+		ProfileCall( selector, MicrosecondClock() - begin );
+	}
+	else
+	{
+		(*gCall4D)( selector, eb );
+	}
+	
+	if ( eb->fError != 0 )
+	{
+		PA_ulong32 slot = sErrorHistoryCount.fetch_add( 1, std::memory_order_acq_rel ) % PA_ERROR_HISTORY_SIZE;
+		sErrorHistory[ slot ].store( ( (PA_ulong32) (unsigned short) selector << 16 ) | (unsigned short) eb->fError, std::memory_order_release );
+	}
+}
+
 // -----------------------------------------
 //
 // 4D Application memory manager
@@ -4048,21 +4182,23 @@ void PA_ResizeArray( PA_Variable *ar, PA_long32 nb )
 				break;
 
 			case eVK_ArrayBlob :
-				// dispose in memory picture handles that will be removed
+				// dispose in memory blob handles that will be removed
 				// if array become smaller
 				if ( nb < ar->uValue.fArray.fNbElements )
 				{
-					PA_Blob** ptBlobHandle = (PA_Blob**) PA_LockHandle( ar->uValue.fArray.fData );
+					PA_Blob* ptBlobs = (PA_Blob*) PA_LockHandle( ar->uValue.fArray.fData );
 
 					for ( i = nb + 1; i <= ar->uValue.fArray.fNbElements; i++ )
 					{
-						PA_DisposeHandle(ptBlobHandle[i]->fHandle);
+						if ( ptBlobs[ i ].fHandle )
+							PA_DisposeHandle( ptBlobs[ i ].fHandle );
 					}
 					
 					PA_UnlockHandle( ar->uValue.fArray.fData );
 				}
-				size = nb1 * (PA_long32) sizeof( PA_Handle );
-				oldSize = oldCount * (PA_long32) sizeof( PA_Handle );
+				// elements are PA_Blob, as read by PA_GetBlobInArray
+				size = nb1 * (PA_long32) sizeof( PA_Blob );
+				oldSize = oldCount * (PA_long32) sizeof( PA_Blob );
 				break;
 
 			case eVK_ArrayUnicode :
@@ -5701,6 +5837,33 @@ void PA_YieldAbsolute()
 }
 
 
+static std::atomic<PA_long32> sYieldSlice( PA_YIELD_SLICE );
+static thread_local PA_ulong64 sLastYield = 0;
+static thread_local PA_ulong32 sYieldCalls = 0;
+
+void PA_YieldIfNeeded()
+{
+	if ( ++sYieldCalls % PA_YIELD_CHECK_INTERVAL )
+		return;
+	
+	PA_ulong64 now = MicrosecondClock();
+	if ( sLastYield == 0 )
+	{
+		sLastYield = now;
+	}
+	else if ( now - sLastYield >= (PA_ulong64) sYieldSlice.load( std::memory_order_relaxed ) )
+	{
+		PA_YieldAbsolute();
+		sLastYield = MicrosecondClock();
+	}
+}
+
+void PA_SetYieldSlice( PA_long32 microseconds )
+{
+	sYieldSlice.store( microseconds > 0 ? microseconds : PA_YIELD_SLICE, std::memory_order_relaxed );
+}
+
+
 char PA_WaitNextEvent( PA_Event* ev )
 {
 	EngineBlock eb;
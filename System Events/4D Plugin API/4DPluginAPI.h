@@ -14,6 +14,8 @@
 #include "Flags.h"
 #include "PublicTypes.h"
 
+#include <stdio.h>
+
 #include <string>
 #include <vector>
 #include <map>
@@ -25,6 +27,8 @@
 #include "C_REAL.h"
 #include "C_TEXT.h"
 #include "C_BLOB.h"
+#include "C_BLOB_VIEW.h"
+#include "C_BLOB_BUILDER.h"
 #include "C_POINTER.h"
 #include "C_PICTURE.h"
 
@@ -35,6 +39,7 @@
 #include "ARRAY_LONGINT.h"
 #include "ARRAY_TIME.h"
 #include "ARRAY_DATE.h"
+#include "ARRAY_BLOB.h"
 
 //some external libraries assume first load; include this file after them 
 #if VERSIONWIN
@@ -61,6 +66,33 @@ void CommandDispatcher (PA_long32 pProcNum, sLONG_PTR *pResult, PackagePtr pPara
 
 PA_ErrorCode PA_GetLastError();
 
+// ---------------------------------------------------------------
+// The error code is kept per thread. In addition, the last errors
+// returned by 4D on any thread are kept with the selector of the
+// call that raised them. Fills at most count entries, newest first,
+// and returns the number of entries filled.
+// ---------------------------------------------------------------
+
+#define PA_ERROR_HISTORY_SIZE 64
+
+PA_long32 PA_GetErrorHistory( short* selectors, PA_ErrorCode* errors, PA_long32 count );
+
+// ---------------------------------------------------------------
+// While profiling is enabled, the number of calls to 4D and the
+// total and longest time they took, in microseconds, are kept per
+// selector. Enabling profiling clears the previous figures.
+// PA_GetProfile fills at most count entries, one per selector that
+// was called, and returns the number of entries filled.
+// PA_WriteProfile writes the same figures as tab separated text.
+// ---------------------------------------------------------------
+
+#define PA_PROFILE_SIZE 1024
+
+void      PA_EnableProfiling( char enable );
+char      PA_IsProfiling();
+PA_long32 PA_GetProfile( short* selectors, PA_ulong64* counts, PA_ulong64* totals, PA_ulong64* maxima, PA_long32 count );
+char      PA_WriteProfile( FILE* file );
+
 
 // ---------------------------------------------------------------
 // After a call to PA_UseVirtualStructure(), all pending calls to
@@ -704,12 +736,21 @@ PA_long32 PA_GetFrontWindowProcess   ( char withPalette );
 void PA_SetWindowProcess        ( PA_WindowRef windowRef, PA_long32 process );
 void PA_Yield                   ( );
 void PA_YieldAbsolute           ( );
+void PA_YieldIfNeeded           ( );
+void PA_SetYieldSlice           ( PA_long32 microseconds );
 char PA_WaitNextEvent		    ( PA_Event* event );
 void PA_UpdateProcessVariable   ( PA_long32 process );
 void PA_BringProcessToFront     ( PA_long32 process );
 PA_long32 PA_NewProcess				( void* procPtr, PA_long32 stackSize, PA_Unichar* name );
 void PA_PostMacEvent            ( PA_long32 process, PA_Event* event );
 
+// Long loops call PA_YieldIfNeeded on every iteration. It only yields
+// once the calling thread has run for a whole slice since its last
+// yield, 2 ms unless changed by PA_SetYieldSlice, and reads the clock
+// once every PA_YIELD_CHECK_INTERVAL calls.
+#define PA_YIELD_SLICE 2000
+#define PA_YIELD_CHECK_INTERVAL 256
+
 // Execute some C code in Main Process. Function should be declared as void myFunc(void*)
 // It may be mandatory for some API call on MacOSX like calling system dialogs
 void PA_RunInMainProcess        ( PA_RunInMainProcessProcPtr procPtr, void* parameters );
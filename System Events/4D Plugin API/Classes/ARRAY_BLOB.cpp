@@ -7,8 +7,37 @@
  */
 
 #include "ARRAY_BLOB.h"
+#include "C_BLOB.h"
 
-void ARRAY_BLOB::fromParamAtIndex(PackagePtr pParams, uint32_t index)
+static PA_Handle copyHandle(PA_Handle h)
+{
+	PA_long32 size = PA_GetHandleSize(h);
+	PA_Handle d = PA_NewHandle(size);
+	
+	if(d && size)//  0 is apparently a range violation on windows
+	{
+		PA_MoveBlock(PA_LockHandle(h), PA_LockHandle(d), size);
+		PA_UnlockHandle(d);
+		PA_UnlockHandle(h);
+	}
+	
+	return d;
+}
+
+static PA_Handle newHandleWithBytes(const uint8_t *bytes, uint32_t len)
+{
+	PA_Handle d = PA_NewHandle(len);
+	
+	if(d && len)
+	{
+		PA_MoveBlock((void *)bytes, PA_LockHandle(d), len);
+		PA_UnlockHandle(d);
+	}
+	
+	return d;
+}
+
+void ARRAY_BLOB::fromParamAtIndex(PackagePtr pParams, uint16_t index)
 {	
 	if(index)		
 	{
@@ -20,13 +49,12 @@ void ARRAY_BLOB::fromParamAtIndex(PackagePtr pParams, uint32_t index)
 		{	
 			uint32_t i;
 			
-			PA_Unistring str;
+			this->_CBLOBArray->reserve(arr.uValue.fArray.fNbElements + 1);
 			
 			for(i = 0; i <= (uint32_t)arr.uValue.fArray.fNbElements; i++)
 			{				
-				str = (*(PA_Unistring **) (arr.uValue.fArray.fData))[i];
-				CUTF16String u = CUTF16String(str.fString, str.fLength);
-				this->_CUTF16StringArray->push_back(u);
+				CBLOBElement element = {PA_GetBlobInArray(arr, i).fHandle, false};
+				this->_CBLOBArray->push_back(element);
 			}
 			
 		}
@@ -35,7 +63,7 @@ void ARRAY_BLOB::fromParamAtIndex(PackagePtr pParams, uint32_t index)
 	
 }
 
-void ARRAY_BLOB::toParamAtIndex(PackagePtr pParams, uint32_t index)
+void ARRAY_BLOB::toParamAtIndex(PackagePtr pParams, uint16_t index)
 {
 	if(index)		
 	{
@@ -58,18 +86,41 @@ void ARRAY_BLOB::toParamAtIndex(PackagePtr pParams, uint32_t index)
 		
 		if(arr.fType == eVK_ArrayBlob)
 		{
+			uint32_t i;
+			uint32_t size = (uint32_t)this->_CBLOBArray->size();
 			
-			PA_ResizeArray(&arr, this->_CBLOBArray->empty() ? 0 : (uint32_t)(this->_CBLOBArray->size() - 1));
+			//	borrowed handles may be elements of this very array, so they are
+			//	copied before the resize or any assignment can dispose of them
+			std::vector<PA_Handle> handles(size);
 			
-			uint32_t i;
+			for(i = 0; i < size; i++)
+			{
+				CBLOBElement &element = this->_CBLOBArray->at(i);
+				
+				if(element.fOwned || !element.fHandle)
+					handles[i] = element.fHandle;
+				else if(PA_GetBlobInArray(arr, i).fHandle == element.fHandle)
+					handles[i] = NULL;
+				else
+					handles[i] = copyHandle(element.fHandle);
+			}
 			
-			for(i = 0; i < this->_CBLOBArray->size(); i++)
+			PA_ResizeArray(&arr, size ? size - 1 : 0);
+			
+			for(i = 0; i < size; i++)
 			{
-				C_BLOB blob = this->_CBLOBArray->at(i));
-                
-                PA_SetBlobInArray(arr, i, );
-                
-				PA_SetStringInArray(arr, i, &str);					
+				CBLOBElement &element = this->_CBLOBArray->at(i);
+				
+				if(handles[i] || !element.fHandle)
+				{
+					PA_Blob blob;
+					blob.fHandle = handles[i];
+					blob.fSize = handles[i] ? PA_GetHandleSize(handles[i]) : 0;
+					PA_SetBlobInArray(arr, i, blob);
+					
+					element.fHandle = handles[i];
+					element.fOwned = false;
+				}
 			}
 			
 			param->fFiller = 0;
@@ -83,30 +134,73 @@ void ARRAY_BLOB::toParamAtIndex(PackagePtr pParams, uint32_t index)
 	
 }
 
-void ARRAY_BLOB::appendDataValue(&C_BLOB dataValue)
+void ARRAY_BLOB::disposeElement(uint32_t index)
+{
+	CBLOBElement &element = this->_CBLOBArray->at(index);
+	
+	if(element.fOwned && element.fHandle)
+		PA_DisposeHandle(element.fHandle);
+	
+	element.fHandle = NULL;
+	element.fOwned = false;
+}
+
+void ARRAY_BLOB::appendDataValue(C_BLOB &dataValue)
 {
-    this->_CBLOBArray->push_back(dataValue);	
+	this->appendHandle(newHandleWithBytes(dataValue.getBytesPtr(), dataValue.getBytesLength()));
 }
 
-void ARRAY_BLOB::setDataValueAtIndex(&C_BLOB dataValue, uint32_t index)
+void ARRAY_BLOB::setDataValueAtIndex(C_BLOB &dataValue, uint32_t index)
 {
-    if(index < this->_CBLOBArray->size())
-    {
-        
-        std::vector<int>::iterator it = this->_CBLOBArray->begin();
-        it += index;
-        
-        this->_CBLOBArray->insert(this->_CBLOBArray->erase(it), dataValue);
-        
-    }
+	if(index < this->_CBLOBArray->size())
+	{
+		this->setHandleAtIndex(newHandleWithBytes(dataValue.getBytesPtr(), dataValue.getBytesLength()), index);
+	}
+}
+
+void ARRAY_BLOB::getDataValueAtIndex(C_BLOB &dataValue, uint32_t index)	
+{
+	if(index < this->_CBLOBArray->size())
+	{
+		PA_Handle h = this->_CBLOBArray->at(index).fHandle;
+		PA_long32 size = h ? PA_GetHandleSize(h) : 0;
+		
+		if(size)
+		{
+			dataValue.setBytes((const uint8_t *)PA_LockHandle(h), size);
+			PA_UnlockHandle(h);
+		}
+		else
+		{
+			dataValue.setBytes((const uint8_t *)"", 0);
+		}
+	}
 }
 
-void ARRAY_BLOB::getDataValueAtIndex(&C_BLOB dataValue, uint32_t index)	
+void ARRAY_BLOB::appendHandle(PA_Handle handle)
 {
-    if(index < this->_CBLOBArray->size())
-    {
-        dataValue = C_BLOB(this->_CBLOBArray->at(index));
-    }
+	CBLOBElement element = {handle, true};
+	this->_CBLOBArray->push_back(element);
+}
+
+void ARRAY_BLOB::setHandleAtIndex(PA_Handle handle, uint32_t index)
+{
+	if(index < this->_CBLOBArray->size())
+	{
+		this->disposeElement(index);
+		
+		CBLOBElement &element = this->_CBLOBArray->at(index);
+		element.fHandle = handle;
+		element.fOwned = true;
+	}
+}
+
+PA_Handle ARRAY_BLOB::getHandleAtIndex(uint32_t index)
+{
+	if(index < this->_CBLOBArray->size())
+		return this->_CBLOBArray->at(index).fHandle;
+	
+	return NULL;
 }
 
 uint32_t ARRAY_BLOB::getSize()
@@ -116,7 +210,11 @@ uint32_t ARRAY_BLOB::getSize()
 
 void ARRAY_BLOB::setSize(uint32_t size)
 {	
-	this->_CBLOBArray->resize(size);
+	for(uint32_t i = size; i < this->_CBLOBArray->size(); i++)
+		this->disposeElement(i);
+	
+	CBLOBElement empty = {NULL, false};
+	this->_CBLOBArray->resize(size, empty);
 }
 
 ARRAY_BLOB::ARRAY_BLOB() : _CBLOBArray(new CBLOBArray)
@@ -126,5 +224,6 @@ ARRAY_BLOB::ARRAY_BLOB() : _CBLOBArray(new CBLOBArray)
 
 ARRAY_BLOB::~ARRAY_BLOB()
 { 
+	this->setSize(0);
 	delete _CBLOBArray; 
-}
\ No newline at end of file
+}
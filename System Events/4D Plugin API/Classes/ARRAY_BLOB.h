@@ -10,14 +10,22 @@
 #define __ARRAY_BLOB_H__ 1
 
 #include "4DPluginAPI.h"
-#include "C_BLOB.h"
+
+class C_BLOB;
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-	typedef std::vector<C_BLOB> CBLOBArray;
-	typedef std::vector<C_BLOB> CBLOBArray;		
+	//	elements read from 4D are borrowed and stay 4D's; elements added
+	//	by the plugin are owned until they are handed to 4D
+	typedef struct
+	{
+		PA_Handle fHandle;
+		bool fOwned;
+	} CBLOBElement;
+	
+	typedef std::vector<CBLOBElement> CBLOBArray;
 	
 class ARRAY_BLOB
 {
@@ -25,16 +33,28 @@ class ARRAY_BLOB
 private:
 
 	CBLOBArray* _CBLOBArray;
+	
+	void disposeElement(uint32_t index);
+	
+	ARRAY_BLOB(const ARRAY_BLOB&);
+	ARRAY_BLOB& operator=(const ARRAY_BLOB&);
         
 public:
  
-    void fromParamAtIndex(PackagePtr pParams, uint16_t index);
-    void toParamAtIndex(PackagePtr pParams, uint16_t index);	
-    
-    void appendDataValue(&C_BLOB dataValue);	
-    
-    void setDataValueAtIndex(&C_BLOB dataValue, uint32_t index);	
-    void getDataValueAtIndex(&C_BLOB dataValue, uint32_t index);
+	//	borrows the handles of the array, which are valid until the command returns
+	void fromParamAtIndex(PackagePtr pParams, uint16_t index);
+	//	owned handles move into the array, borrowed ones are copied unless
+	//	they are already at that index
+	void toParamAtIndex(PackagePtr pParams, uint16_t index);	
+	
+	void appendDataValue(C_BLOB &dataValue);	
+	void setDataValueAtIndex(C_BLOB &dataValue, uint32_t index);	
+	void getDataValueAtIndex(C_BLOB &dataValue, uint32_t index);
+	
+	//	takes ownership of handle, e.g. from C_BLOB_BUILDER::detach
+	void appendHandle(PA_Handle handle);
+	void setHandleAtIndex(PA_Handle handle, uint32_t index);
+	PA_Handle getHandleAtIndex(uint32_t index);
 	
 	uint32_t getSize();
 	void setSize(uint32_t size);
@@ -48,4 +68,4 @@ public:
 }
 #endif
 
-#endif
\ No newline at end of file
+#endif
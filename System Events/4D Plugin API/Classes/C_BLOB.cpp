@@ -17,6 +17,7 @@ void CBytes::fromParamAtIndex(PackagePtr pParams, uint32_t index)
 		{
 			unsigned int size = PA_GetHandleSize(h);
 			
+			this->clearChunks();
 			this->_CBytes.resize(size);
 			
 			PA_MoveBlock(PA_LockHandle(h), (char *)&this->_CBytes[0], size);		
@@ -33,12 +34,11 @@ void CBytes::toParamAtIndex(PackagePtr pParams, uint32_t index)
 		
 		if (*h) PA_DisposeHandle(*h);
 				
-		PA_Handle d = PA_NewHandle((unsigned int)this->_CBytes.size());
+		PA_Handle d = PA_NewHandle(this->getBytesLength());
         
-        if(this->_CBytes.size())//  0 is apparently a range violation on windows
+        if(this->getBytesLength())//  0 is apparently a range violation on windows
         {
-            PA_MoveBlock((char *)&this->_CBytes[0], PA_LockHandle(d), (unsigned int)this->_CBytes.size());
-            PA_UnlockHandle(d);
+            this->copyTo(d);
         }
 		
 		*h = d;
@@ -49,6 +49,7 @@ void CBytes::setBytes(const uint8_t *bytes, unsigned int len)
 {	
 	if(bytes)
 	{
+		this->clearChunks();
 		this->_CBytes.resize(len);
 		PA_MoveBlock((void *)bytes, (char *)&this->_CBytes[0], len);	
 	}
@@ -56,7 +57,20 @@ void CBytes::setBytes(const uint8_t *bytes, unsigned int len)
 
 void CBytes::addBytes(const uint8_t *bytes, unsigned int len)
 {	
-	if(bytes)
+	//	appends never move bytes already in chunks; getBytesPtr and the text
+	//	conversions join the chunks first
+	if(bytes && (this->_chunks.size() || (this->_CBytes.size() >= CBYTES_CHUNK_SIZE)))
+	{
+		if(this->_chunks.empty() || (this->_chunks.back().capacity() - this->_chunks.back().size() < len))
+		{
+			this->_chunks.push_back(std::vector<uint8_t>());
+			this->_chunks.back().reserve(len > CBYTES_CHUNK_SIZE ? len : CBYTES_CHUNK_SIZE);
+		}
+		std::vector<uint8_t> &chunk = this->_chunks.back();
+		chunk.insert(chunk.end(), bytes, bytes + len);
+		this->_chunkedLength += len;
+	}
+	else if(bytes)
 	{
 		unsigned int originalSize = this->_CBytes.size();
 		this->_CBytes.resize(originalSize + len);
@@ -69,19 +83,69 @@ void CBytes::setReturn(sLONG_PTR *pResult)
 {
 	PA_Handle *h = (PA_Handle *)pResult;
 	
-	PA_Handle d = PA_NewHandle((unsigned int)this->_CBytes.size());
+	PA_Handle d = PA_NewHandle(this->getBytesLength());
     
-    if(this->_CBytes.size())//  0 is apparently a range violation on windows
+    if(this->getBytesLength())//  0 is apparently a range violation on windows
     {
-        PA_MoveBlock((char *)&this->_CBytes[0], PA_LockHandle(d), (unsigned int)this->_CBytes.size());
-        PA_UnlockHandle(d);
+        this->copyTo(d);
     }
 	
 	*h = d;
 }
 
+//	gathers the segments straight into the handle, without joining them first
+void CBytes::copyTo(PA_Handle h)
+{
+	char *dest = PA_LockHandle(h);
+	
+	if(this->_CBytes.size())
+	{
+		PA_MoveBlock((char *)&this->_CBytes[0], dest, (unsigned int)this->_CBytes.size());
+		dest += this->_CBytes.size();
+	}
+	
+	for(size_t i = 0; i < this->_chunks.size(); ++i)
+	{
+		if(this->_chunks[i].size())
+		{
+			PA_MoveBlock((char *)&this->_chunks[i][0], dest, (unsigned int)this->_chunks[i].size());
+			dest += this->_chunks[i].size();
+		}
+	}
+	
+	PA_UnlockHandle(h);
+}
+
+const std::vector<uint8_t>& CBytes::segment(size_t index)
+{
+	return index ? this->_chunks[index - 1] : this->_CBytes;
+}
+
+void CBytes::flatten()
+{
+	if(this->_chunks.empty())
+		return;
+	
+	this->_CBytes.reserve(this->_CBytes.size() + this->_chunkedLength);
+	
+	for(size_t i = 0; i < this->_chunks.size(); ++i)
+		this->_CBytes.insert(this->_CBytes.end(), this->_chunks[i].begin(), this->_chunks[i].end());
+	
+	this->clearChunks();
+}
+
+void CBytes::clearChunks()
+{
+	this->_chunks.clear();
+	this->_chunkedLength = 0;
+	this->_cursorSegment = 0;
+	this->_segmentStart = 0;
+}
+
 const uint8_t *CBytes::getBytesPtr()
 {
+	this->flatten();
+	
 	if(this->_CBytes.size())
 		return (const uint8_t *)&this->_CBytes[0];
 
@@ -90,21 +154,58 @@ const uint8_t *CBytes::getBytesPtr()
 
 uint32_t CBytes::getBytesLength()
 {
-	return (unsigned int)this->_CBytes.size();
+	return (unsigned int)this->_CBytes.size() + this->_chunkedLength;
 }
 
+//	a read within one segment is served in place; one that spans segments is
+//	gathered into _gathered, so size is only cut short at the end of the bytes
 const uint8_t *CBytes::getBytesPtrForSize(uint32_t *size)
 {
 
-	int len = this->_CBytes.size() - this->_cursorPosition;
+	int len = this->getBytesLength() - this->_cursorPosition;
 	const uint8_t *ptr = NULL;
 	
 	if(len > 0){
 	
-		ptr = (const uint8_t *)&this->_CBytes[(this->_cursorPosition)];
-		
 		if((*size) > (unsigned int)len) {*size = len;}
 		
+		if(this->_cursorPosition < this->_segmentStart)
+		{
+			this->_cursorSegment = 0;
+			this->_segmentStart = 0;
+		}
+		
+		while(this->_cursorPosition >= this->_segmentStart + this->segment(this->_cursorSegment).size())
+		{
+			this->_segmentStart += (uint32_t)this->segment(this->_cursorSegment).size();
+			this->_cursorSegment++;
+		}
+		
+		uint32_t offset = this->_cursorPosition - this->_segmentStart;
+		
+		if((*size) > this->segment(this->_cursorSegment).size() - offset)
+		{
+			this->_gathered.resize(*size);
+			
+			uint32_t gathered = 0;
+			for(size_t i = this->_cursorSegment; gathered < (*size); ++i)
+			{
+				const std::vector<uint8_t> &s = this->segment(i);
+				uint32_t n = (uint32_t)s.size() - offset;
+				if(n > (*size) - gathered) {n = (*size) - gathered;}
+				if(n)
+				{
+					PA_MoveBlock((char *)&s[offset], (char *)&this->_gathered[gathered], n);
+					gathered += n;
+				}
+				offset = 0;
+			}
+			
+			ptr = (const uint8_t *)&this->_gathered[0];
+		}else{
+			ptr = (const uint8_t *)&this->segment(this->_cursorSegment)[offset];
+		}
+		
 		this->_cursorPosition = this->_cursorPosition + (*size);
 		
 	}else{
@@ -117,6 +218,7 @@ const uint8_t *CBytes::getBytesPtrForSize(uint32_t *size)
 
 void CBytes::toHexText(C_TEXT *hex)
 {
+	this->flatten();
 	
 	CUTF8String u;
 	
@@ -124,7 +226,7 @@ void CBytes::toHexText(C_TEXT *hex)
 	const std::vector<uint8_t>::const_iterator binend = this->_CBytes.end();
 	
 	for (std::vector<uint8_t>::const_iterator i = this->_CBytes.begin(); i != binend; ++i) {
-        PA_YieldAbsolute();
+        PA_YieldIfNeeded();
 #if VERSIONMAC
 		sprintf((char *)&buf[0], "%02x", *i);
 #else
@@ -149,10 +251,11 @@ void CBytes::fromHexText(C_TEXT *hex)
 	BOOL data_in_buffer = false;
 	int buf = 0;
 	
+	this->clearChunks();
 	this->_CBytes.resize(0);
 	
 	for(pos = 0; pos < t.length(); pos++){
-		PA_YieldAbsolute();
+		PA_YieldIfNeeded();
 		size_t f = v.find(t[pos]);
 		
 		if(f == std::string::npos){
@@ -206,6 +309,8 @@ void CBytes::fromB64Text(C_TEXT *b64)
 	CUTF8String t;
 	b64->copyUTF8String(&t);
 	
+	this->flatten();
+	
 	const CUTF8String::const_iterator last = t.end();
 	
 	std::vector<uint8_t> buf(0);	
@@ -214,7 +319,7 @@ void CBytes::fromB64Text(C_TEXT *b64)
 	unsigned int accumulator = 0;
 	
 	for (CUTF8String::const_iterator i = t.begin(); i != last; ++i) {
-        PA_YieldAbsolute();
+        PA_YieldIfNeeded();
 		const int c = *i;
 		if (isspace(c) || c == '=') {
 			// Skip whitespace and padding. Be liberal in what you accept.
@@ -240,6 +345,7 @@ static const char b64_table[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrs
 
 void CBytes::toB64Text(C_TEXT *b64)
 {
+	this->flatten();
 	
 	const ::std::size_t binlen = this->_CBytes.size();
 	
@@ -253,7 +359,7 @@ void CBytes::toB64Text(C_TEXT *b64)
 	const std::vector<uint8_t>::const_iterator binend = this->_CBytes.end();
 	
 	for (std::vector<uint8_t>::const_iterator i = this->_CBytes.begin(); i != binend; ++i) {
-        PA_YieldAbsolute();
+        PA_YieldIfNeeded();
 		accumulator = (accumulator << 8) | (*i & 0xffu);
 		bits_collected += 8;
 		while (bits_collected >= 6) {
@@ -275,7 +381,7 @@ void CBytes::toB64Text(C_TEXT *b64)
 	
 }
 
-CBytes::CBytes() : _cursorPosition(0)
+CBytes::CBytes() : _cursorPosition(0), _chunkedLength(0), _cursorSegment(0), _segmentStart(0)
 {	
 }
 
@@ -11,6 +11,10 @@
 
 #include "4DPluginAPI.h"
 
+//	once the bytes reach this size, appends fill chunks of it instead of
+//	growing them; larger appends get a chunk of their own
+#define CBYTES_CHUNK_SIZE 65536
+
 class C_TEXT;
 
 #ifdef __cplusplus
@@ -25,6 +29,22 @@ extern "C" {
 		std::vector<uint8_t> _CBytes;		
 		uint32_t _cursorPosition;
 		
+		//	the bytes are _CBytes followed by the chunks
+		std::vector< std::vector<uint8_t> > _chunks;
+		uint32_t _chunkedLength;
+		
+		//	segment 0 is _CBytes, segment n is _chunks[n - 1]
+		size_t _cursorSegment;
+		uint32_t _segmentStart;
+		
+		//	a getBytesPtrForSize that spans segments is copied here
+		std::vector<uint8_t> _gathered;
+		
+		const std::vector<uint8_t>& segment(size_t index);
+		void flatten();
+		void clearChunks();
+		void copyTo(PA_Handle h);
+		
 	public:
 		
 		void fromParamAtIndex(PackagePtr pParams, uint32_t index);
@@ -37,6 +57,7 @@ extern "C" {
 		const uint8_t *getBytesPtr();
 		uint32_t getBytesLength();	
 
+		//	valid until the next call or change
 		const uint8_t *getBytesPtrForSize(uint32_t *size);		
 		
 		void fromHexText(C_TEXT *hex);
@@ -0,0 +1,122 @@
+/*
+ *  C_BLOB_BUILDER.cpp
+ *  4D Plugin
+ *
+ */
+
+#include "C_BLOB_BUILDER.h"
+
+//	the capacity doubles so that n appends cost O(log n) handle resizes
+bool C_BLOB_BUILDER::reserve(uint32_t len)
+{
+	if(len <= this->_capacity)
+		return true;
+	
+	if(len > BLOB_BUILDER_MAX_CAPACITY)
+		return false;
+	
+	uint32_t capacity = this->_capacity ? this->_capacity : BLOB_BUILDER_INITIAL_CAPACITY;
+	while(capacity < len)
+		capacity = (capacity > BLOB_BUILDER_MAX_CAPACITY / 2) ? BLOB_BUILDER_MAX_CAPACITY : capacity * 2;
+	
+	if(!this->_handle)
+	{
+		this->_handle = PA_NewHandle(capacity);
+		if(!this->_handle || PA_GetLastError() != eER_NoErr)
+		{
+			this->_handle = NULL;
+			return false;
+		}
+	}
+	else
+	{
+		//	the handle is only locked between resizes so 4D can move it
+		PA_UnlockHandle(this->_handle);
+		this->_bytes = NULL;
+		if(!PA_SetHandleSize(this->_handle, capacity))
+		{
+			this->_bytes = (uint8_t *)PA_LockHandle(this->_handle);
+			return false;
+		}
+	}
+	
+	this->_capacity = capacity;
+	this->_bytes = (uint8_t *)PA_LockHandle(this->_handle);
+	return true;
+}
+
+bool C_BLOB_BUILDER::addBytes(const uint8_t *bytes, uint32_t len)
+{
+	if(!bytes || !len)
+		return true;
+	
+	if(len > BLOB_BUILDER_MAX_CAPACITY - this->_length)
+		return false;
+	
+	if(!this->reserve(this->_length + len))
+		return false;
+	
+	PA_MoveBlock((void *)bytes, (char *)this->_bytes + this->_length, len);
+	this->_length += len;
+	return true;
+}
+
+uint32_t C_BLOB_BUILDER::getBytesLength()
+{
+	return this->_length;
+}
+
+//	trims the spare capacity and gives up ownership of the handle
+PA_Handle C_BLOB_BUILDER::detach()
+{
+	PA_Handle h = this->_handle;
+	
+	if(h)
+	{
+		PA_UnlockHandle(h);
+		PA_SetHandleSize(h, this->_length);
+	}
+	else
+	{
+		h = PA_NewHandle(0);
+	}
+	
+	this->_handle = NULL;
+	this->_bytes = NULL;
+	this->_length = 0;
+	this->_capacity = 0;
+	
+	return h;
+}
+
+void C_BLOB_BUILDER::toParamAtIndex(PackagePtr pParams, uint32_t index)
+{
+	if(index)
+	{
+		PA_Handle *h = (PA_Handle *)(pParams[index - 1]);
+		
+		if (*h) PA_DisposeHandle(*h);
+		
+		*h = this->detach();
+	}
+}
+
+void C_BLOB_BUILDER::setReturn(sLONG_PTR *pResult)
+{
+	PA_Handle *h = (PA_Handle *)pResult;
+	
+	*h = this->detach();
+}
+
+C_BLOB_BUILDER::C_BLOB_BUILDER() : _handle(NULL), _bytes(NULL), _length(0), _capacity(0)
+{
+}
+
+C_BLOB_BUILDER::~C_BLOB_BUILDER()
+{
+	if(this->_handle)
+	{
+		PA_UnlockHandle(this->_handle);
+		PA_DisposeHandle(this->_handle);
+	}
+}
@@ -0,0 +1,58 @@
+/*
+ *  C_BLOB_BUILDER.h
+ *  4D Plugin
+ *
+ *  Builds a BLOB directly in a 4D handle, which is handed to the
+ *  parameter or result without the copy CBytes makes.
+ *
+ */
+
+#ifndef __C_BLOB_BUILDER_H__
+#define __C_BLOB_BUILDER_H__ 1
+
+#include "4DPluginAPI.h"
+
+#define BLOB_BUILDER_INITIAL_CAPACITY 4096
+#define BLOB_BUILDER_MAX_CAPACITY 0x7FFFFFFF
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	
+	class C_BLOB_BUILDER
+	{
+		
+	private:
+		
+		PA_Handle _handle;
+		uint8_t *_bytes;
+		uint32_t _length;
+		uint32_t _capacity;
+		
+		C_BLOB_BUILDER(const C_BLOB_BUILDER&);
+		C_BLOB_BUILDER& operator=(const C_BLOB_BUILDER&);
+		
+	public:
+		
+		//	the handle moves to 4D, the builder is empty afterwards
+		void toParamAtIndex(PackagePtr pParams, uint32_t index);
+		void setReturn(sLONG_PTR *pResult);
+		//	the caller owns the handle, e.g. ARRAY_BLOB::appendHandle
+		PA_Handle detach();
+		
+		//	false if 4D could not grow the handle, nothing is written then
+		bool reserve(uint32_t len);
+		bool addBytes(const uint8_t *bytes, uint32_t len);
+		
+		uint32_t getBytesLength();
+		
+		C_BLOB_BUILDER();
+		~C_BLOB_BUILDER();
+		
+	};
+	
+#ifdef __cplusplus
+}
+#endif
+
+#endif
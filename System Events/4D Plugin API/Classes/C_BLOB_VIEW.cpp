@@ -0,0 +1,76 @@
+/*
+ *  C_BLOB_VIEW.cpp
+ *  4D Plugin
+ *
+ */
+
+#include "C_BLOB_VIEW.h"
+
+void C_BLOB_VIEW::fromParamAtIndex(PackagePtr pParams, uint32_t index)
+{
+	this->release();
+	
+	if(index)
+	{
+		PA_Handle h = *(PA_Handle *)(pParams[index - 1]);
+		if(h)//	the handle could be NULL if the BLOB is empty on windows
+		{
+			this->_length = PA_GetHandleSize(h);
+			if(this->_length)
+			{
+				this->_handle = h;
+				this->_bytes = (const uint8_t *)PA_LockHandle(h);
+			}
+		}
+	}
+}
+
+void C_BLOB_VIEW::release()
+{
+	if(this->_handle)
+		PA_UnlockHandle(this->_handle);
+	
+	this->_handle = NULL;
+	this->_bytes = NULL;
+	this->_length = 0;
+	this->_cursorPosition = 0;
+}
+
+const uint8_t *C_BLOB_VIEW::getBytesPtr()
+{
+	return this->_bytes;
+}
+
+uint32_t C_BLOB_VIEW::getBytesLength()
+{
+	return this->_bytes ? this->_length : 0;
+}
+
+const uint8_t *C_BLOB_VIEW::getBytesPtrForSize(uint32_t *size)
+{
+	uint32_t len = this->getBytesLength() - this->_cursorPosition;
+	const uint8_t *ptr = NULL;
+	
+	if(len > 0){
+		
+		ptr = this->_bytes + this->_cursorPosition;
+		
+		if((*size) > len) {*size = len;}
+		
+		this->_cursorPosition = this->_cursorPosition + (*size);
+		
+	}else{
+		*size = 0;
+	}
+	
+	return ptr;
+}
+
+C_BLOB_VIEW::C_BLOB_VIEW() : _handle(NULL), _bytes(NULL), _length(0), _cursorPosition(0)
+{
+}
+
+C_BLOB_VIEW::~C_BLOB_VIEW()
+{
+	this->release();
+}
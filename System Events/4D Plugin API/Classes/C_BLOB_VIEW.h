@@ -0,0 +1,53 @@
+/*
+ *  C_BLOB_VIEW.h
+ *  4D Plugin
+ *
+ *  Read-only access to a BLOB parameter without copying it: the 4D
+ *  handle stays locked for the lifetime of the view.
+ *
+ */
+
+#ifndef __C_BLOB_VIEW_H__
+#define __C_BLOB_VIEW_H__ 1
+
+#include "4DPluginAPI.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+	
+	class C_BLOB_VIEW
+	{
+		
+	private:
+		
+		PA_Handle _handle;
+		const uint8_t *_bytes;
+		uint32_t _length;
+		uint32_t _cursorPosition;
+		
+		void release();
+		
+		C_BLOB_VIEW(const C_BLOB_VIEW&);
+		C_BLOB_VIEW& operator=(const C_BLOB_VIEW&);
+		
+	public:
+		
+		void fromParamAtIndex(PackagePtr pParams, uint32_t index);
+		
+		//	valid until the view is destroyed or reads another parameter
+		const uint8_t *getBytesPtr();
+		uint32_t getBytesLength();
+		
+		const uint8_t *getBytesPtrForSize(uint32_t *size);
+		
+		C_BLOB_VIEW();
+		~C_BLOB_VIEW();
+		
+	};
+	
+#ifdef __cplusplus
+}
+#endif
+
+#endif
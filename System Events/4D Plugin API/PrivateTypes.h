@@ -83,7 +83,7 @@ typedef struct EngineBlock
 } EngineBlock;
 
 // facility to call back 4D more easily using the proc pointer 
-#define Call4D(s,p) (*gCall4D)(s,p)
+#define Call4D(s,p) Call4DLogged(s,p)
 
 #if VERSIONMAC
 	#define FOURDCALL pascal __attribute__((visibility("default"))) void
@@ -101,6 +101,9 @@ FOURDCALL FourDPackex( PA_long32 selector, void* params, void** data, void* resu
 
 extern Call4DProcPtr gCall4D;
 
+// calls gCall4D and keeps a trace of the errors returned by 4D
+void Call4DLogged( short selector, EngineBlock* eb );
+
 // this structure is sent to Plugin at init.
 typedef struct PackInitBlock
 {
@@ -12,6 +12,13 @@
 #include "4DPlugin.h"
 
 #include "SystemEventsManager.h"
+#include "EventTrace.h"
+#include "EventRing.h"
+#include "EventCodec.h"
+#include "CRC32C.h"
+#include "EventCounters.h"
+#include "MetricsExporter.h"
+#include "FileUtils.h"
 
 void PluginMain(PA_long32 selector, PA_PluginParameters params)
 {
@@ -105,6 +112,150 @@ void CommandDispatcher (PA_long32 pProcNum, sLONG_PTR *pResult, PackagePtr pPara
 			shutdownUnprevent(pResult, pParams);
 			break;
 #endif
+
+		case 14 :
+			sleepSetCallbackID(pResult, pParams);
+			break;
+
+		case 15 :
+			wakeSetCallbackID(pResult, pParams);
+			break;
+
+#if VERSIONWIN
+		case 16 :
+			shutdownSetCallbackID(pResult, pParams);
+			break;
+#endif
+
+// --- System Events
+
+		case 17 :
+			systemEventsGetMethodID(pResult, pParams);
+			break;
+
+		case 18 :
+			systemEventsSetTracing(pResult, pParams);
+			break;
+
+		case 19 :
+			systemEventsFlushTrace(pResult, pParams);
+			break;
+
+		case 20 :
+			systemEventsGetHostErrors(pResult, pParams);
+			break;
+
+		case 21 :
+			systemEventsSetDeadline(pResult, pParams);
+			break;
+
+// --- Sleep
+
+		case 22 :
+			sleepPreventAcquire(pResult, pParams);
+			break;
+
+		case 23 :
+			sleepPreventRelease(pResult, pParams);
+			break;
+
+#if VERSIONWIN
+// --- Shutdown
+
+		case 24 :
+			shutdownPreventAcquire(pResult, pParams);
+			break;
+
+		case 25 :
+			shutdownPreventRelease(pResult, pParams);
+			break;
+#endif
+
+// --- Sleep
+
+		case 26 :
+			sleepPreventLease(pResult, pParams);
+			break;
+
+		case 27 :
+			sleepPreventRenew(pResult, pParams);
+			break;
+
+#if VERSIONWIN
+// --- Shutdown
+
+		case 28 :
+			shutdownPreventLease(pResult, pParams);
+			break;
+
+		case 29 :
+			shutdownPreventRenew(pResult, pParams);
+			break;
+#endif
+
+// --- Wake
+
+		case 30 :
+			wakeGetSuspendedDuration(pResult, pParams);
+			break;
+
+// --- System Events
+
+		case 31 :
+			systemEventsSetFilter(pResult, pParams);
+			break;
+
+		case 32 :
+			systemEventsSetRateLimit(pResult, pParams);
+			break;
+
+		case 33 :
+			systemEventsSetDebounce(pResult, pParams);
+			break;
+
+		case 34 :
+			systemEventsGetSuppressed(pResult, pParams);
+			break;
+
+		case 35 :
+			systemEventsWait(pResult, pParams);
+			break;
+
+		case 36 :
+			systemEventsNext(pResult, pParams);
+			break;
+
+		case 37 :
+			systemEventsGetCounters(pResult, pParams);
+			break;
+
+		case 38 :
+			systemEventsSetExporter(pResult, pParams);
+			break;
+
+		case 39 :
+			systemEventsSetProfiling(pResult, pParams);
+			break;
+
+		case 40 :
+			systemEventsGetProfile(pResult, pParams);
+			break;
+
+		case 41 :
+			systemEventsFlushProfile(pResult, pParams);
+			break;
+
+		case 42 :
+			systemEventsGetHistory(pResult, pParams);
+			break;
+
+		case 43 :
+			systemEventsGetChecksum(pResult, pParams);
+			break;
+
+		case 44 :
+			systemEventsGetHistoryBatches(pResult, pParams);
+			break;
 	}
 }
 
@@ -116,6 +267,7 @@ void InitPlugin()
 void DeinitPlugin()
 {
     SystemEventsManager::destroy();
+    EventTrace::destroy();
 }
 
 void CloseProcess()
@@ -126,6 +278,8 @@ void CloseProcess()
     CUTF16String exitProcName((PA_Unichar *)"$\0x\0x\0\0\0");
     if (!procName.compare(exitProcName))
         SystemEventsManager::stopCallbackLoop();
+    
+    SystemEventsManager::releaseProcessPrevents(PA_GetCurrentProcessNumber());
 }
 
 // ------------------------------------- Sleep ------------------------------------
@@ -134,16 +288,16 @@ void CloseProcess()
 void sleepSetCallback(sLONG_PTR *pResult, PackagePtr pParams)
 {
 	C_TEXT methodName;
+	C_LONGINT returnValue;
 
 	methodName.fromParamAtIndex(pParams, 1);
 
 	// --- write the code of sleepSetCallback here...
     
-    PA_Unichar* name = (PA_Unichar*)methodName.getUTF16StringPtr();
+    CUTF16String name(methodName.getUTF16StringPtr(), methodName.getUTF16Length());
     
-    PA_long32 methodID = PA_GetMethodID(name);
-
-    SystemEventsManager::setCallback(SYSTEM_SLEEP, methodID);
+    returnValue.setIntValue(SystemEventsManager::setCallback(SYSTEM_SLEEP, name));
+	returnValue.setReturn(pResult);
 }
 
 void sleepRegisterCallback(sLONG_PTR *pResult, PackagePtr pParams)
@@ -174,22 +328,88 @@ void sleepUnprevent(sLONG_PTR *pResult, PackagePtr pParams)
     SystemEventsManager::prevent(SYSTEM_SLEEP, false);
 }
 
+void sleepPreventAcquire(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT returnValue;
+
+	// --- write the code of sleepPreventAcquire here...
+
+    returnValue.setIntValue((int)SystemEventsManager::acquirePrevent(SYSTEM_SLEEP, PA_GetCurrentProcessNumber()));
+	returnValue.setReturn(pResult);
+}
+
+void sleepPreventRelease(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT token;
+	C_LONGINT returnValue;
+
+	token.fromParamAtIndex(pParams, 1);
+
+	// --- write the code of sleepPreventRelease here...
+
+    returnValue.setIntValue(SystemEventsManager::releasePrevent(SYSTEM_SLEEP, (long)token.getIntValue()));
+	returnValue.setReturn(pResult);
+}
+
+void sleepPreventLease(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT seconds;
+	C_LONGINT returnValue;
+
+	seconds.fromParamAtIndex(pParams, 1);
+
+	// --- write the code of sleepPreventLease here...
+
+    int duration = seconds.getIntValue();
+    returnValue.setIntValue((int)SystemEventsManager::acquireLease(SYSTEM_SLEEP, PA_GetCurrentProcessNumber(), duration > 0 ? duration : 0));
+	returnValue.setReturn(pResult);
+}
+
+void sleepPreventRenew(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT token;
+	C_LONGINT seconds;
+	C_LONGINT returnValue;
+
+	token.fromParamAtIndex(pParams, 1);
+	seconds.fromParamAtIndex(pParams, 2);
+
+	// --- write the code of sleepPreventRenew here...
+
+    int duration = seconds.getIntValue();
+    returnValue.setIntValue(SystemEventsManager::renewLease(SYSTEM_SLEEP, (long)token.getIntValue(), duration > 0 ? duration : 0));
+	returnValue.setReturn(pResult);
+}
+
+void sleepSetCallbackID(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT methodID;
+	C_LONGINT returnValue;
+
+	methodID.fromParamAtIndex(pParams, 1);
+
+	// --- write the code of sleepSetCallbackID here...
+
+    returnValue.setIntValue(SystemEventsManager::setCallback(SYSTEM_SLEEP, (long)methodID.getIntValue()));
+	returnValue.setReturn(pResult);
+}
+
 // ------------------------------------- Wake -------------------------------------
 
 
 void wakeSetCallback(sLONG_PTR *pResult, PackagePtr pParams)
 {
 	C_TEXT methodName;
+	C_LONGINT returnValue;
 
 	methodName.fromParamAtIndex(pParams, 1);
 
 	// --- write the code of wakeSetCallback here...
     
-    PA_Unichar* name = (PA_Unichar*)methodName.getUTF16StringPtr();
-    
-    PA_long32 methodID = PA_GetMethodID(name);
+    CUTF16String name(methodName.getUTF16StringPtr(), methodName.getUTF16Length());
     
-    SystemEventsManager::setCallback(SYSTEM_WAKE, methodID);
+    returnValue.setIntValue(SystemEventsManager::setCallback(SYSTEM_WAKE, name));
+	returnValue.setReturn(pResult);
 }
 
 void wakeRegisterCallback(sLONG_PTR *pResult, PackagePtr pParams)
@@ -206,6 +426,433 @@ void wakeUnregisterCallback(sLONG_PTR *pResult, PackagePtr pParams)
     SystemEventsManager::unregisterCallback(SYSTEM_WAKE);
 }
 
+void wakeSetCallbackID(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT methodID;
+	C_LONGINT returnValue;
+
+	methodID.fromParamAtIndex(pParams, 1);
+
+	// --- write the code of wakeSetCallbackID here...
+
+    returnValue.setIntValue(SystemEventsManager::setCallback(SYSTEM_WAKE, (long)methodID.getIntValue()));
+	returnValue.setReturn(pResult);
+}
+
+void wakeGetSuspendedDuration(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_REAL returnValue;
+
+	// --- write the code of wakeGetSuspendedDuration here...
+
+    returnValue.setDoubleValue(SystemEventsManager::getSuspendedDuration());
+	returnValue.setReturn(pResult);
+}
+
+// --------------------------------- System Events --------------------------------
+
+
+void systemEventsGetMethodID(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_TEXT methodName;
+	C_LONGINT returnValue;
+
+	methodName.fromParamAtIndex(pParams, 1);
+
+	// --- write the code of systemEventsGetMethodID here...
+
+    CUTF16String name(methodName.getUTF16StringPtr(), methodName.getUTF16Length());
+
+    returnValue.setIntValue((int)SystemEventsManager::getMethodID(name));
+	returnValue.setReturn(pResult);
+}
+
+void systemEventsSetTracing(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT enabled;
+
+	enabled.fromParamAtIndex(pParams, 1);
+
+	// --- write the code of systemEventsSetTracing here...
+
+    EventTrace::enable(enabled.getIntValue() != 0);
+}
+
+void systemEventsFlushTrace(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_TEXT path;
+	C_LONGINT returnValue;
+
+	path.fromParamAtIndex(pParams, 1);
+
+	// --- write the code of systemEventsFlushTrace here...
+
+    CUTF8String posixPath;
+    path.copyPath(&posixPath);
+
+    returnValue.setIntValue(EventTrace::flush((const char*)posixPath.c_str()) ? SYSTEM_EVENTS_OK : SYSTEM_EVENTS_ERR_IO);
+	returnValue.setReturn(pResult);
+}
+
+void systemEventsGetHostErrors(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	ARRAY_LONGINT selectors;
+	ARRAY_LONGINT errors;
+
+	// --- write the code of systemEventsGetHostErrors here...
+
+    short selectorValues[PA_ERROR_HISTORY_SIZE];
+    PA_ErrorCode errorValues[PA_ERROR_HISTORY_SIZE];
+    PA_long32 count = PA_GetErrorHistory(selectorValues, errorValues, PA_ERROR_HISTORY_SIZE);
+
+    selectors.appendIntValue(0);
+    errors.appendIntValue(0);
+    for (PA_long32 i = 0; i < count; ++i) {
+        selectors.appendIntValue(selectorValues[i]);
+        errors.appendIntValue(errorValues[i]);
+    }
+
+	selectors.toParamAtIndex(pParams, 1);
+	errors.toParamAtIndex(pParams, 2);
+}
+
+void systemEventsSetDeadline(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT event;
+	C_LONGINT milliseconds;
+	C_LONGINT returnValue;
+
+	event.fromParamAtIndex(pParams, 1);
+	milliseconds.fromParamAtIndex(pParams, 2);
+
+	// --- write the code of systemEventsSetDeadline here...
+
+    int deadline = milliseconds.getIntValue();
+    returnValue.setIntValue(SystemEventsManager::setDeadline(event.getIntValue(), deadline > 0 ? deadline : 0));
+	returnValue.setReturn(pResult);
+}
+
+void systemEventsSetFilter(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT event;
+	C_TEXT filter;
+	C_LONGINT returnValue;
+
+	event.fromParamAtIndex(pParams, 1);
+	filter.fromParamAtIndex(pParams, 2);
+
+	// --- write the code of systemEventsSetFilter here...
+
+    CUTF8String text;
+    filter.copyUTF8String(&text);
+
+    returnValue.setIntValue(SystemEventsManager::setFilter(event.getIntValue(), std::string((const char*)text.c_str(), text.length())));
+	returnValue.setReturn(pResult);
+}
+
+void systemEventsSetRateLimit(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT event;
+	C_REAL rate;
+	C_REAL burst;
+	C_LONGINT returnValue;
+
+	event.fromParamAtIndex(pParams, 1);
+	rate.fromParamAtIndex(pParams, 2);
+	burst.fromParamAtIndex(pParams, 3);
+
+	// --- write the code of systemEventsSetRateLimit here...
+
+    returnValue.setIntValue(SystemEventsManager::setRateLimit(event.getIntValue(), rate.getDoubleValue(), burst.getDoubleValue()));
+	returnValue.setReturn(pResult);
+}
+
+void systemEventsSetDebounce(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT event;
+	C_LONGINT milliseconds;
+	C_LONGINT returnValue;
+
+	event.fromParamAtIndex(pParams, 1);
+	milliseconds.fromParamAtIndex(pParams, 2);
+
+	// --- write the code of systemEventsSetDebounce here...
+
+    int window = milliseconds.getIntValue();
+    returnValue.setIntValue(SystemEventsManager::setDebounce(event.getIntValue(), window > 0 ? window : 0));
+	returnValue.setReturn(pResult);
+}
+
+void systemEventsGetSuppressed(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT event;
+	C_LONGINT rateLimited;
+	C_LONGINT debounced;
+
+	event.fromParamAtIndex(pParams, 1);
+
+	// --- write the code of systemEventsGetSuppressed here...
+
+    // the same totals as systemEventsGetCounters reports
+    int eventID = event.getIntValue();
+    if (eventID >= 0 && eventID < SYSTEM_EVENT_COUNT) {
+        rateLimited.setIntValue((int)EventCounters::get(eventID, COUNTER_RATE_LIMITED));
+        debounced.setIntValue((int)EventCounters::get(eventID, COUNTER_DEBOUNCED));
+    }
+
+	rateLimited.toParamAtIndex(pParams, 2);
+	debounced.toParamAtIndex(pParams, 3);
+}
+
+void systemEventsWait(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT mask;
+	C_LONGINT timeout;
+	C_LONGINT returnValue;
+
+	mask.fromParamAtIndex(pParams, 1);
+	timeout.fromParamAtIndex(pParams, 2);
+
+	// --- write the code of systemEventsWait here...
+
+    int milliseconds = timeout.getIntValue();
+    returnValue.setIntValue(SystemEventsManager::waitForEvent((unsigned int)mask.getIntValue(), milliseconds > 0 ? milliseconds : 0));
+	returnValue.setReturn(pResult);
+}
+
+void systemEventsNext(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_REAL cursor;
+	ARRAY_LONGINT events;
+	ARRAY_REAL parameters;
+	ARRAY_REAL timestamps;
+	C_LONGINT returnValue;
+
+	cursor.fromParamAtIndex(pParams, 1);
+
+	// --- write the code of systemEventsNext here...
+
+    std::vector<EventRecord> records;
+    bool overrun;
+    uint64_t next = EventRing::next(EventRing::toCursor(cursor.getDoubleValue()), records, overrun);
+
+    events.appendIntValue(0);
+    parameters.appendDoubleValue(0);
+    timestamps.appendDoubleValue(0);
+    for (size_t i = 0; i < records.size(); ++i) {
+        events.appendIntValue(records[i].event);
+        parameters.appendDoubleValue(records[i].parameter);
+        timestamps.appendDoubleValue(records[i].timestamp);
+    }
+    cursor.setDoubleValue((double)next);
+    returnValue.setIntValue(overrun ? 1 : 0);
+
+	cursor.toParamAtIndex(pParams, 1);
+	events.toParamAtIndex(pParams, 2);
+	parameters.toParamAtIndex(pParams, 3);
+	timestamps.toParamAtIndex(pParams, 4);
+	returnValue.setReturn(pResult);
+}
+
+void systemEventsGetHistory(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_REAL cursor;
+	C_BLOB_BUILDER history;
+	C_LONGINT returnValue;
+
+	cursor.fromParamAtIndex(pParams, 1);
+
+	// --- write the code of systemEventsGetHistory here...
+
+    // same records as systemEventsNext, encoded as described in EventCodec.h
+    std::vector<EventRecord> records;
+    bool overrun;
+    uint64_t next = EventRing::next(EventRing::toCursor(cursor.getDoubleValue()), records, overrun);
+
+    // the cursor stays put when 4D could not hold the records
+    if (EventRecordWriter::encode(history, records.data(), records.size())) {
+        cursor.setDoubleValue((double)next);
+        returnValue.setIntValue(overrun ? 1 : 0);
+    } else {
+        returnValue.setIntValue(SYSTEM_EVENTS_ERR_IO);
+    }
+
+	cursor.toParamAtIndex(pParams, 1);
+	history.toParamAtIndex(pParams, 2);
+	returnValue.setReturn(pResult);
+}
+
+void systemEventsGetHistoryBatches(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_REAL cursor;
+	ARRAY_BLOB batches;
+	C_LONGINT size;
+	C_LONGINT returnValue;
+
+	cursor.fromParamAtIndex(pParams, 1);
+	size.fromParamAtIndex(pParams, 3);
+
+	// --- write the code of systemEventsGetHistoryBatches here...
+
+    // the records of systemEventsGetHistory split into BLOBs of at most size
+    // records, each built in its own handle and moved into the array
+    std::vector<EventRecord> records;
+    bool overrun;
+    uint64_t next = EventRing::next(EventRing::toCursor(cursor.getDoubleValue()), records, overrun);
+    size_t batchSize = size.getIntValue() > 0 ? (size_t)size.getIntValue() : records.size();
+
+    C_BLOB empty;
+    batches.appendDataValue(empty);
+    bool complete = true;
+    for (size_t first = 0; complete && first < records.size(); first += batchSize) {
+        size_t count = records.size() - first < batchSize ? records.size() - first : batchSize;
+        C_BLOB_BUILDER batch;
+        complete = EventRecordWriter::encode(batch, records.data() + first, count);
+        if (complete)
+            batches.appendHandle(batch.detach());
+    }
+
+    if (complete) {
+        cursor.setDoubleValue((double)next);
+        returnValue.setIntValue(overrun ? 1 : 0);
+    } else {
+        batches.setSize(1);
+        returnValue.setIntValue(SYSTEM_EVENTS_ERR_IO);
+    }
+
+	cursor.toParamAtIndex(pParams, 1);
+	batches.toParamAtIndex(pParams, 2);
+	returnValue.setReturn(pResult);
+}
+
+void systemEventsGetChecksum(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_BLOB_VIEW data;
+	C_REAL returnValue;
+
+	data.fromParamAtIndex(pParams, 1);
+
+	// --- write the code of systemEventsGetChecksum here...
+
+    // CRC32C of any BLOB, read in place; a real since a longint is signed
+    returnValue.setDoubleValue(CRC32C::update(0, data.getBytesPtr(), data.getBytesLength()));
+	returnValue.setReturn(pResult);
+}
+
+void systemEventsGetCounters(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	ARRAY_TEXT names;
+	ARRAY_REAL values;
+
+	// --- write the code of systemEventsGetCounters here...
+
+    std::vector<std::string> counterNames;
+    std::vector<double> counterValues;
+    EventCounters::read(counterNames, counterValues);
+
+    names.appendUTF8String((const uint8_t*)"", 0);
+    values.appendDoubleValue(0);
+    for (size_t i = 0; i < counterNames.size(); ++i) {
+        names.appendUTF8String((const uint8_t*)counterNames[i].c_str(), (uint32_t)counterNames[i].length());
+        values.appendDoubleValue(counterValues[i]);
+    }
+
+	names.toParamAtIndex(pParams, 1);
+	values.toParamAtIndex(pParams, 2);
+}
+
+void systemEventsSetExporter(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_TEXT path;
+	C_LONGINT interval;
+	C_LONGINT returnValue;
+
+	path.fromParamAtIndex(pParams, 1);
+	interval.fromParamAtIndex(pParams, 2);
+
+	// --- write the code of systemEventsSetExporter here...
+
+    // an empty path or a zero interval turns the exporter off
+    CUTF8String posixPath;
+    path.copyPath(&posixPath);
+
+    if (posixPath.empty() || interval.getIntValue() <= 0) {
+        MetricsExporter::stop();
+        returnValue.setIntValue(SYSTEM_EVENTS_OK);
+    } else {
+        bool started = MetricsExporter::start(std::string((const char*)posixPath.c_str()), (unsigned int)interval.getIntValue());
+        returnValue.setIntValue(started ? SYSTEM_EVENTS_OK : SYSTEM_EVENTS_ERR_IO);
+    }
+	returnValue.setReturn(pResult);
+}
+
+void systemEventsSetProfiling(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT enabled;
+
+	enabled.fromParamAtIndex(pParams, 1);
+
+	// --- write the code of systemEventsSetProfiling here...
+
+    PA_EnableProfiling(enabled.getIntValue() != 0);
+}
+
+void systemEventsGetProfile(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	ARRAY_LONGINT selectors;
+	ARRAY_REAL counts;
+	ARRAY_REAL totals;
+	ARRAY_REAL maxima;
+
+	// --- write the code of systemEventsGetProfile here...
+
+    std::vector<short> selectorValues(PA_PROFILE_SIZE);
+    std::vector<PA_ulong64> countValues(PA_PROFILE_SIZE);
+    std::vector<PA_ulong64> totalValues(PA_PROFILE_SIZE);
+    std::vector<PA_ulong64> maxValues(PA_PROFILE_SIZE);
+    PA_long32 count = PA_GetProfile(&selectorValues[0], &countValues[0], &totalValues[0], &maxValues[0], PA_PROFILE_SIZE);
+
+    // durations in milliseconds
+    selectors.appendIntValue(0);
+    counts.appendDoubleValue(0);
+    totals.appendDoubleValue(0);
+    maxima.appendDoubleValue(0);
+    for (PA_long32 i = 0; i < count; ++i) {
+        selectors.appendIntValue(selectorValues[i]);
+        counts.appendDoubleValue((double)countValues[i]);
+        totals.appendDoubleValue(totalValues[i] / 1000.0);
+        maxima.appendDoubleValue(maxValues[i] / 1000.0);
+    }
+
+	selectors.toParamAtIndex(pParams, 1);
+	counts.toParamAtIndex(pParams, 2);
+	totals.toParamAtIndex(pParams, 3);
+	maxima.toParamAtIndex(pParams, 4);
+}
+
+void systemEventsFlushProfile(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_TEXT path;
+	C_LONGINT returnValue;
+
+	path.fromParamAtIndex(pParams, 1);
+
+	// --- write the code of systemEventsFlushProfile here...
+
+    CUTF8String posixPath;
+    path.copyPath(&posixPath);
+
+    bool ok = false;
+    FILE* file = openUTF8File((const char*)posixPath.c_str(), "wb");
+    if (file) {
+        ok = PA_WriteProfile(file) != 0;
+        ok = (fclose(file) == 0) && ok;
+    }
+
+    returnValue.setIntValue(ok ? SYSTEM_EVENTS_OK : SYSTEM_EVENTS_ERR_IO);
+	returnValue.setReturn(pResult);
+}
+
 #if VERSIONWIN
 
 // ----------------------------------- Shutdown -----------------------------------
@@ -214,16 +861,16 @@ void wakeUnregisterCallback(sLONG_PTR *pResult, PackagePtr pParams)
 void shutdownSetCallback(sLONG_PTR *pResult, PackagePtr pParams)
 {
 	C_TEXT methodName;
+	C_LONGINT returnValue;
 
 	methodName.fromParamAtIndex(pParams, 1);
 
 	// --- write the code of shutdownSetCallback here...
-
-    PA_Unichar* name = (PA_Unichar*)methodName.getUTF16StringPtr();
     
-    PA_long32 methodID = PA_GetMethodID(name);
+    CUTF16String name(methodName.getUTF16StringPtr(), methodName.getUTF16Length());
     
-    SystemEventsManager::setCallback(SYSTEM_SHUTDOWN, methodID);
+    returnValue.setIntValue(SystemEventsManager::setCallback(SYSTEM_SHUTDOWN, name));
+	returnValue.setReturn(pResult);
 }
 
 void shutdownRegisterCallback(sLONG_PTR *pResult, PackagePtr pParams)
@@ -254,4 +901,70 @@ void shutdownUnprevent(sLONG_PTR *pResult, PackagePtr pParams)
     SystemEventsManager::prevent(SYSTEM_SHUTDOWN, false);
 }
 
+void shutdownPreventAcquire(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT returnValue;
+
+	// --- write the code of shutdownPreventAcquire here...
+
+    returnValue.setIntValue((int)SystemEventsManager::acquirePrevent(SYSTEM_SHUTDOWN, PA_GetCurrentProcessNumber()));
+	returnValue.setReturn(pResult);
+}
+
+void shutdownPreventRelease(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT token;
+	C_LONGINT returnValue;
+
+	token.fromParamAtIndex(pParams, 1);
+
+	// --- write the code of shutdownPreventRelease here...
+
+    returnValue.setIntValue(SystemEventsManager::releasePrevent(SYSTEM_SHUTDOWN, (long)token.getIntValue()));
+	returnValue.setReturn(pResult);
+}
+
+void shutdownPreventLease(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT seconds;
+	C_LONGINT returnValue;
+
+	seconds.fromParamAtIndex(pParams, 1);
+
+	// --- write the code of shutdownPreventLease here...
+
+    int duration = seconds.getIntValue();
+    returnValue.setIntValue((int)SystemEventsManager::acquireLease(SYSTEM_SHUTDOWN, PA_GetCurrentProcessNumber(), duration > 0 ? duration : 0));
+	returnValue.setReturn(pResult);
+}
+
+void shutdownPreventRenew(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT token;
+	C_LONGINT seconds;
+	C_LONGINT returnValue;
+
+	token.fromParamAtIndex(pParams, 1);
+	seconds.fromParamAtIndex(pParams, 2);
+
+	// --- write the code of shutdownPreventRenew here...
+
+    int duration = seconds.getIntValue();
+    returnValue.setIntValue(SystemEventsManager::renewLease(SYSTEM_SHUTDOWN, (long)token.getIntValue(), duration > 0 ? duration : 0));
+	returnValue.setReturn(pResult);
+}
+
+void shutdownSetCallbackID(sLONG_PTR *pResult, PackagePtr pParams)
+{
+	C_LONGINT methodID;
+	C_LONGINT returnValue;
+
+	methodID.fromParamAtIndex(pParams, 1);
+
+	// --- write the code of shutdownSetCallbackID here...
+
+    returnValue.setIntValue(SystemEventsManager::setCallback(SYSTEM_SHUTDOWN, (long)methodID.getIntValue()));
+	returnValue.setReturn(pResult);
+}
+
 #endif
@@ -19,11 +19,39 @@ void sleepRegisterCallback(sLONG_PTR *pResult, PackagePtr pParams);
 void sleepUnregisterCallback(sLONG_PTR *pResult, PackagePtr pParams);
 void sleepPrevent(sLONG_PTR *pResult, PackagePtr pParams);
 void sleepUnprevent(sLONG_PTR *pResult, PackagePtr pParams);
+void sleepSetCallbackID(sLONG_PTR *pResult, PackagePtr pParams);
+void sleepPreventAcquire(sLONG_PTR *pResult, PackagePtr pParams);
+void sleepPreventRelease(sLONG_PTR *pResult, PackagePtr pParams);
+void sleepPreventLease(sLONG_PTR *pResult, PackagePtr pParams);
+void sleepPreventRenew(sLONG_PTR *pResult, PackagePtr pParams);
 
 // --- Wake
 void wakeSetCallback(sLONG_PTR *pResult, PackagePtr pParams);
 void wakeRegisterCallback(sLONG_PTR *pResult, PackagePtr pParams);
 void wakeUnregisterCallback(sLONG_PTR *pResult, PackagePtr pParams);
+void wakeSetCallbackID(sLONG_PTR *pResult, PackagePtr pParams);
+void wakeGetSuspendedDuration(sLONG_PTR *pResult, PackagePtr pParams);
+
+// --- System Events
+void systemEventsGetMethodID(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsSetTracing(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsFlushTrace(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsGetHostErrors(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsSetDeadline(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsSetFilter(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsSetRateLimit(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsSetDebounce(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsGetSuppressed(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsWait(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsNext(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsGetCounters(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsSetExporter(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsSetProfiling(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsGetProfile(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsFlushProfile(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsGetHistory(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsGetChecksum(sLONG_PTR *pResult, PackagePtr pParams);
+void systemEventsGetHistoryBatches(sLONG_PTR *pResult, PackagePtr pParams);
 
 #if VERSIONWIN
 // --- Shutdown
@@ -32,4 +60,9 @@ void shutdownRegisterCallback(sLONG_PTR *pResult, PackagePtr pParams);
 void shutdownUnregisterCallback(sLONG_PTR *pResult, PackagePtr pParams);
 void shutdownPrevent(sLONG_PTR *pResult, PackagePtr pParams);
 void shutdownUnprevent(sLONG_PTR *pResult, PackagePtr pParams);
+void shutdownSetCallbackID(sLONG_PTR *pResult, PackagePtr pParams);
+void shutdownPreventAcquire(sLONG_PTR *pResult, PackagePtr pParams);
+void shutdownPreventRelease(sLONG_PTR *pResult, PackagePtr pParams);
+void shutdownPreventLease(sLONG_PTR *pResult, PackagePtr pParams);
+void shutdownPreventRenew(sLONG_PTR *pResult, PackagePtr pParams);
 #endif
\ No newline at end of file
@@ -0,0 +1,149 @@
+//
+//  CRC32C.cpp
+//  System Events
+//
+
+#include <string.h>
+
+#include "CRC32C.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CRC32C_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <nmmintrin.h>
+#define CRC32C_TARGET
+#else
+#include <cpuid.h>
+#include <nmmintrin.h>
+// only this function is built for SSE 4.2, it runs after the cpuid check
+#define CRC32C_TARGET __attribute__((target("sse4.2")))
+#endif
+#elif defined(__ARM_FEATURE_CRC32)
+#define CRC32C_ARM 1
+#include <arm_acle.h>
+#endif
+
+// reflected Castagnoli polynomial
+#define CRC32C_POLYNOMIAL 0x82F63B78
+
+struct CRC32CTables {
+    uint32_t table[8][256];
+    bool accelerated;
+
+    CRC32CTables() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & (0 - (crc & 1)));
+            table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int slice = 1; slice < 8; ++slice)
+                table[slice][i] = (table[slice - 1][i] >> 8) ^ table[0][table[slice - 1][i] & 0xFF];
+        }
+
+        accelerated = false;
+#if CRC32C_X86
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        accelerated = (info[2] & (1 << 20)) != 0;
+#else
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+            accelerated = (ecx & bit_SSE4_2) != 0;
+#endif
+#elif CRC32C_ARM
+        accelerated = true;
+#endif
+    }
+};
+
+static const CRC32CTables tables;
+
+static uint32_t updateSliceBy8(uint32_t crc, const uint8_t* p, size_t length) {
+    while (length && ((uintptr_t)p & 7)) {
+        crc = (crc >> 8) ^ tables.table[0][(crc ^ *p++) & 0xFF];
+        --length;
+    }
+    while (length >= 8) {
+        uint32_t low, high;
+        memcpy(&low, p, 4);
+        memcpy(&high, p + 4, 4);
+        // the tables are for little endian words, as on every target
+        low ^= crc;
+        crc = tables.table[7][low & 0xFF] ^ tables.table[6][(low >> 8) & 0xFF]
+            ^ tables.table[5][(low >> 16) & 0xFF] ^ tables.table[4][low >> 24]
+            ^ tables.table[3][high & 0xFF] ^ tables.table[2][(high >> 8) & 0xFF]
+            ^ tables.table[1][(high >> 16) & 0xFF] ^ tables.table[0][high >> 24];
+        p += 8;
+        length -= 8;
+    }
+    while (length--)
+        crc = (crc >> 8) ^ tables.table[0][(crc ^ *p++) & 0xFF];
+    return crc;
+}
+
+#if CRC32C_X86
+static CRC32C_TARGET uint32_t updateHardware(uint32_t crc, const uint8_t* p, size_t length) {
+    while (length && ((uintptr_t)p & 7)) {
+        crc = _mm_crc32_u8(crc, *p++);
+        --length;
+    }
+#if defined(__x86_64__) || defined(_M_X64)
+    uint64_t wide = crc;
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        wide = _mm_crc32_u64(wide, word);
+        p += 8;
+        length -= 8;
+    }
+    crc = (uint32_t)wide;
+#else
+    while (length >= 4) {
+        uint32_t word;
+        memcpy(&word, p, 4);
+        crc = _mm_crc32_u32(crc, word);
+        p += 4;
+        length -= 4;
+    }
+#endif
+    while (length--)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+#elif CRC32C_ARM
+static uint32_t updateHardware(uint32_t crc, const uint8_t* p, size_t length) {
+    while (length && ((uintptr_t)p & 7)) {
+        crc = __crc32cb(crc, *p++);
+        --length;
+    }
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc = __crc32cd(crc, word);
+        p += 8;
+        length -= 8;
+    }
+    while (length--)
+        crc = __crc32cb(crc, *p++);
+    return crc;
+}
+#endif
+
+uint32_t CRC32C::update(uint32_t crc, const uint8_t* bytes, size_t length) {
+    crc = ~crc;
+    if (!bytes || !length)
+        return ~crc;
+#if CRC32C_X86 || CRC32C_ARM
+    if (tables.accelerated)
+        return ~updateHardware(crc, bytes, length);
+#endif
+    return ~updateSliceBy8(crc, bytes, length);
+}
+
+bool CRC32C::isAccelerated() {
+    return tables.accelerated;
+}
@@ -0,0 +1,22 @@
+//
+//  CRC32C.h
+//  System Events
+//
+//  CRC-32C (Castagnoli), with the SSE 4.2 or ARMv8 CRC instructions when
+//  the processor has them and slice-by-8 tables otherwise.
+//
+
+#ifndef CRC32C_h
+#define CRC32C_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+class CRC32C {
+public:
+    // continues crc, the result of an earlier call or 0 to start, over the bytes
+    static uint32_t update(uint32_t, const uint8_t*, size_t);
+    static bool isAccelerated();
+};
+
+#endif /* CRC32C_h */
@@ -8,41 +8,156 @@
 
 #include "Event.h"
 
-Event::Event() {
-    registered = false;
-    prevented = false;
-    callback = -1;
+Subscription::Subscription(long methodID, const EventFilter& eventFilter)
+: callback(methodID), filter(eventFilter), rate(0), burst(0), debounce(0) {
+}
+
+Event::Event() : flags(0), subscription(nullptr), deadline(0), preventCount(0),
+tokens(0), refilledAt(0), deferred(false), deferredParameterCount(0), deferredParameter(0) {
+}
+
+// back to the state of a new entry; returns the snapshot for the caller to
+// delete once the notification thread is stopped
+Subscription* Event::reset() {
+    flags.store(0, std::memory_order_release);
+    deadline.store(0, std::memory_order_release);
+    preventCount.store(0, std::memory_order_release);
+    tokens = 0;
+    refilledAt = 0;
+    deferred = false;
+    deferredParameterCount = 0;
+    deferredParameter = 0;
+    return subscription.exchange(nullptr);
 }
 
 bool Event::isRegistered() {
-    return registered;
+    return (flags.load(std::memory_order_acquire) & EVENT_REGISTERED) != 0;
 }
 
 bool Event::isPrevented() {
-    return prevented;
+    return (flags.load(std::memory_order_acquire) & EVENT_PREVENTED) != 0;
 }
 
 bool Event::isEnabled() {
-    return registered || prevented;
+    return flags.load(std::memory_order_acquire) != 0;
+}
+
+// the setters copy the current snapshot, change one field and publish the
+// copy; they return the previous snapshot, which the caller retires once no
+// reader can hold it, and must be serialized by the caller; sequentially
+// consistent so the caller's read of the epoch cannot move before it
+Subscription* Event::publish(Subscription* next) {
+    return subscription.exchange(next);
+}
+
+static Subscription* copySubscription(Subscription* current) {
+    return current ? new Subscription(*current) : new Subscription(-1, EventFilter());
 }
 
-void Event::setCallback(long methodID) {
-    callback = methodID;
+Subscription* Event::setCallback(long methodID) {
+    Subscription* next = copySubscription(subscription.load(std::memory_order_acquire));
+    next->callback = methodID;
+    return publish(next);
+}
+
+Subscription* Event::setFilter(const EventFilter& filter) {
+    Subscription* next = copySubscription(subscription.load(std::memory_order_acquire));
+    next->filter = filter;
+    return publish(next);
+}
+
+Subscription* Event::setRateLimit(double rate, double burst) {
+    Subscription* next = copySubscription(subscription.load(std::memory_order_acquire));
+    next->rate = rate;
+    next->burst = burst < 1 ? 1 : burst;
+    return publish(next);
+}
+
+Subscription* Event::setDebounce(unsigned int milliseconds) {
+    Subscription* next = copySubscription(subscription.load(std::memory_order_acquire));
+    next->debounce = milliseconds;
+    return publish(next);
 }
 
 long Event::getCallback() {
-    return callback;
+    Subscription* current = subscription.load(std::memory_order_acquire);
+    return current ? current->callback : -1;
+}
+
+Subscription* Event::getSubscription() {
+    return subscription.load(std::memory_order_acquire);
 }
 
 void Event::registerCallback() {
-    if (callback != -1)
-        registered = true;
+    if (getCallback() != -1)
+        flags.fetch_or(EVENT_REGISTERED, std::memory_order_acq_rel);
 }
 
 void Event::unregisterCallback() {
-    registered = false;
+    flags.fetch_and(~EVENT_REGISTERED, std::memory_order_acq_rel);
+}
+
+// the prevented flag follows the hold count; callers serialize acquire and
+// release so the flag cannot lag behind a concurrent transition
+// returns true for the first hold
+bool Event::acquirePrevent() {
+    if (preventCount.fetch_add(1, std::memory_order_acq_rel) != 0)
+        return false;
+    flags.fetch_or(EVENT_PREVENTED, std::memory_order_acq_rel);
+    return true;
+}
+
+// returns true when the last hold is released
+bool Event::releasePrevent() {
+    if (preventCount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return false;
+    flags.fetch_and(~EVENT_PREVENTED, std::memory_order_acq_rel);
+    return true;
+}
+
+// milliseconds the notification thread waits for the 4D method before
+// replying to the OS; 0 replies immediately
+void Event::setDeadline(unsigned int milliseconds) {
+    deadline.store(milliseconds, std::memory_order_release);
 }
 
-void Event::prevent(bool prevent) {
-    prevented = prevent;
-}
\ No newline at end of file
+unsigned int Event::getDeadline() {
+    return deadline.load(std::memory_order_acquire);
+}
+
+// refills the bucket for the time elapsed since the last event (now in ms)
+// and spends one token; false when the bucket is empty
+bool Event::takeToken(double rate, double burst, uint64_t now) {
+    if (refilledAt == 0) {
+        tokens = burst;
+    } else if (now > refilledAt) {
+        tokens += (now - refilledAt) * rate / 1000;
+        if (tokens > burst)
+            tokens = burst;
+    }
+    refilledAt = now;
+    
+    if (tokens >= 1) {
+        tokens -= 1;
+        return true;
+    }
+    return false;
+}
+
+// keeps the latest event of a burst; returns true when it replaces one
+bool Event::defer(int parameterCount, double parameter) {
+    bool replaced = deferred;
+    deferred = true;
+    deferredParameterCount = parameterCount;
+    deferredParameter = parameter;
+    return replaced;
+}
+
+bool Event::takeDeferred(int& parameterCount, double& parameter) {
+    if (!deferred)
+        return false;
+    deferred = false;
+    parameterCount = deferredParameterCount;
+    parameter = deferredParameter;
+    return true;
+}
@@ -9,28 +9,76 @@
 #ifndef Event_hpp
 #define Event_hpp
 
-class Event {
+#include <atomic>
+#include <stdint.h>
+
+#include "EventFilter.h"
+
+#define EVENT_REGISTERED 0x1
+#define EVENT_PREVENTED 0x2
+
+#define EVENT_CACHE_LINE 64
+
+// published once by setCallback and never modified afterwards, so the
+// notification thread can read it without taking a lock
+struct Subscription {
+    long callback;
+    EventFilter filter;
+    // token bucket: events per second and bucket size, 0 rate for no limit
+    double rate;
+    double burst;
+    // trailing-edge debounce window in ms, 0 to deliver every event
+    unsigned int debounce;
+    
+    Subscription(long, const EventFilter&);
+};
+
+// one entry per event type, each on its own cache line
+class alignas(EVENT_CACHE_LINE) Event {
 private:
-    bool registered;
-    bool prevented;
+    std::atomic<unsigned int> flags;
+    std::atomic<Subscription*> subscription;
+    std::atomic<unsigned int> deadline;
+    std::atomic<unsigned int> preventCount;
     
-    long callback;
+    // throttling state, only touched by the notification thread
+    double tokens;
+    uint64_t refilledAt;
+    bool deferred;
+    int deferredParameterCount;
+    double deferredParameter;
+    
+    Subscription* publish(Subscription*);
     
 public:
     Event();
     
+    Subscription* reset();
+    
     bool isRegistered();
     bool isPrevented();
     
     bool isEnabled();
     
-    void setCallback(long);
+    Subscription* setCallback(long);
+    Subscription* setFilter(const EventFilter&);
+    Subscription* setRateLimit(double, double);
+    Subscription* setDebounce(unsigned int);
     long getCallback();
+    Subscription* getSubscription();
     
     void registerCallback();
     void unregisterCallback();
     
-    void prevent(bool);
+    bool acquirePrevent();
+    bool releasePrevent();
+    
+    void setDeadline(unsigned int);
+    unsigned int getDeadline();
+    
+    bool takeToken(double, double, uint64_t);
+    bool defer(int, double);
+    bool takeDeferred(int&, double&);
 };
 
 #endif /* Event_hpp */
@@ -0,0 +1,157 @@
+//
+//  EventCodec.cpp
+//  System Events
+//
+
+#include <math.h>
+#include <string.h>
+
+#include "EventCodec.h"
+#include "CRC32C.h"
+
+static const uint8_t magic[4] = { 'S', 'E', 'V', 'R' };
+
+static uint8_t* putVarint(uint8_t* p, uint64_t value) {
+    while (value >= 0x80) {
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+static bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = *p++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static uint8_t* putChecksum(uint8_t* p, uint32_t checksum) {
+    for (int i = 0; i < EVENT_CODEC_CHECKSUM_SIZE; ++i)
+        *p++ = (uint8_t)(checksum >> (8 * i));
+    return p;
+}
+
+static uint32_t getChecksum(const uint8_t* p) {
+    uint32_t checksum = 0;
+    for (int i = 0; i < EVENT_CODEC_CHECKSUM_SIZE; ++i)
+        checksum |= (uint32_t)p[i] << (8 * i);
+    return checksum;
+}
+
+EventRecordWriter::EventRecordWriter(C_BLOB_BUILDER& bytes)
+    : bytes(bytes), lastSequence(0), lastTimestamp(0), checksum(0), complete(true) {
+    uint8_t header[EVENT_CODEC_HEADER_SIZE];
+    memcpy(header, magic, sizeof(magic));
+    header[4] = EVENT_CODEC_VERSION;
+    complete = bytes.addBytes(header, sizeof(header));
+    checksum = CRC32C::update(checksum, header, sizeof(header));
+}
+
+void EventRecordWriter::write(const EventRecord& record) {
+    uint8_t buffer[EVENT_CODEC_MAX_RECORD_SIZE];
+    uint8_t* p = buffer;
+    int64_t timestamp = (int64_t)llround(record.timestamp * 1000);
+    bool hasParameter = record.parameter != 0;
+
+    p = putVarint(p, record.sequence - lastSequence);
+    p = putVarint(p, ((uint64_t)(uint32_t)record.event << 1) | (hasParameter ? 1 : 0));
+    p = putVarint(p, zigzag(timestamp - lastTimestamp));
+    if (hasParameter) {
+        uint64_t bits;
+        memcpy(&bits, &record.parameter, sizeof(bits));
+        for (int i = 0; i < 8; ++i)
+            *p++ = (uint8_t)(bits >> (8 * i));
+    }
+    p = putChecksum(p, CRC32C::update(0, buffer, p - buffer));
+    complete = bytes.addBytes(buffer, (uint32_t)(p - buffer)) && complete;
+    checksum = CRC32C::update(checksum, buffer, p - buffer);
+
+    lastSequence = record.sequence;
+    lastTimestamp = timestamp;
+}
+
+bool EventRecordWriter::finish() {
+    uint8_t trailer[EVENT_CODEC_CHECKSUM_SIZE];
+    putChecksum(trailer, checksum);
+    complete = bytes.addBytes(trailer, sizeof(trailer)) && complete;
+    return complete;
+}
+
+bool EventRecordWriter::encode(C_BLOB_BUILDER& bytes, const EventRecord* records, size_t count) {
+    // the handle is trimmed when it is handed over
+    bytes.reserve((uint32_t)(EVENT_CODEC_HEADER_SIZE + count * EVENT_CODEC_MAX_RECORD_SIZE + EVENT_CODEC_CHECKSUM_SIZE));
+    EventRecordWriter writer(bytes);
+    for (size_t i = 0; i < count; ++i)
+        writer.write(records[i]);
+    return writer.finish();
+}
+
+EventRecordReader::EventRecordReader(const uint8_t* bytes, uint32_t length)
+    : start(bytes), position(bytes), end(bytes + length), lastSequence(0), lastTimestamp(0), valid(false) {
+    if (bytes && length >= EVENT_CODEC_HEADER_SIZE + EVENT_CODEC_CHECKSUM_SIZE && memcmp(bytes, magic, sizeof(magic)) == 0
+        && bytes[4] == EVENT_CODEC_VERSION) {
+        position += EVENT_CODEC_HEADER_SIZE;
+        valid = true;
+    }
+}
+
+bool EventRecordReader::next(EventRecord& record) {
+    if (!valid || position == end)
+        return false;
+    // records are never shorter than three varints and a checksum, so what
+    // is left when only a checksum fits is the trailer
+    if (end - position <= EVENT_CODEC_CHECKSUM_SIZE) {
+        valid = end - position == EVENT_CODEC_CHECKSUM_SIZE
+            && getChecksum(position) == CRC32C::update(0, start, position - start);
+        position = end;
+        return false;
+    }
+
+    const uint8_t* fields = position;
+    uint64_t sequence, type, timestamp;
+    if (!getVarint(position, end, sequence) || !getVarint(position, end, type)
+        || !getVarint(position, end, timestamp)) {
+        valid = false;
+        return false;
+    }
+    record.parameter = 0;
+    if (type & 1) {
+        if (end - position < 8) {
+            valid = false;
+            return false;
+        }
+        uint64_t bits = 0;
+        for (int i = 0; i < 8; ++i)
+            bits |= (uint64_t)position[i] << (8 * i);
+        memcpy(&record.parameter, &bits, sizeof(bits));
+        position += 8;
+    }
+    // the trailer must still follow, otherwise the BLOB was cut after a record
+    if (end - position < 2 * EVENT_CODEC_CHECKSUM_SIZE
+        || getChecksum(position) != CRC32C::update(0, fields, position - fields)) {
+        valid = false;
+        return false;
+    }
+    position += EVENT_CODEC_CHECKSUM_SIZE;
+
+    lastSequence += sequence;
+    lastTimestamp += unzigzag(timestamp);
+    record.sequence = lastSequence;
+    record.event = (int)(type >> 1);
+    record.timestamp = lastTimestamp / 1000.0;
+    return true;
+}
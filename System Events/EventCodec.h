@@ -0,0 +1,71 @@
+//
+//  EventCodec.h
+//  System Events
+//
+//  Binary form of the event history, for moving it into 4D as a single
+//  BLOB. After a 4 byte magic and a version byte, each record is:
+//    varint   sequence, as the difference from the previous record
+//    varint   event << 1, with bit 0 set when a parameter follows
+//    varint   timestamp in milliseconds, zigzag encoded difference
+//             from the previous record
+//    8 bytes  parameter, little endian double, if bit 0 was set
+//    4 bytes  CRC32C of the fields above, little endian
+//  The first record is encoded against sequence 0 and timestamp 0. The
+//  BLOB ends with the CRC32C of everything before it, so a reader can tell
+//  a damaged record from a truncated or spliced BLOB.
+//
+
+#ifndef EventCodec_h
+#define EventCodec_h
+
+#include <stdint.h>
+
+#include "4DPluginAPI.h"
+
+#include "EventRing.h"
+
+#define EVENT_CODEC_VERSION 2
+#define EVENT_CODEC_HEADER_SIZE 5
+// the longest varint is 10 bytes, three of them, a double and a checksum
+#define EVENT_CODEC_MAX_RECORD_SIZE 42
+#define EVENT_CODEC_CHECKSUM_SIZE 4
+
+// writes straight into the handle that goes to 4D
+class EventRecordWriter {
+private:
+    C_BLOB_BUILDER& bytes;
+    uint64_t lastSequence;
+    int64_t lastTimestamp;
+    // CRC32C of the bytes written so far, for the trailer
+    uint32_t checksum;
+    // false once 4D could not grow the handle
+    bool complete;
+public:
+    // writes the header
+    EventRecordWriter(C_BLOB_BUILDER&);
+    void write(const EventRecord&);
+    // writes the trailer, call it after the last record; false if any
+    // bytes could not be written
+    bool finish();
+    // encodes count records as one BLOB, reserving the worst case first
+    static bool encode(C_BLOB_BUILDER&, const EventRecord*, size_t);
+};
+
+// reads the records straight from the encoded bytes, which must outlive it
+class EventRecordReader {
+private:
+    const uint8_t* start;
+    const uint8_t* position;
+    const uint8_t* end;
+    uint64_t lastSequence;
+    int64_t lastTimestamp;
+    bool valid;
+public:
+    EventRecordReader(const uint8_t*, uint32_t);
+    // false at the end of the records, or on malformed input or a checksum
+    // mismatch which also clear isValid()
+    bool next(EventRecord&);
+    bool isValid() const { return valid; }
+};
+
+#endif /* EventCodec_h */
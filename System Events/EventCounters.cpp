@@ -0,0 +1,133 @@
+//
+//  EventCounters.cpp
+//  System Events
+//
+
+#include <new>
+#include <stdlib.h>
+
+#include "EventCounters.h"
+
+std::atomic<CounterShard*> EventCounters::shards(nullptr);
+std::atomic<bool> EventCounters::timing(false);
+
+const uint64_t EventCounters::bucketBounds[HISTOGRAM_BUCKET_COUNT - 1] = {
+    1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000
+};
+
+static const char* eventNames[COUNTER_EVENT_COUNT] = { "sleep", "wake", "shutdown" };
+static const char* counterNames[COUNTER_COUNT] = {
+    "received", "filtered", "debounced", "rate_limited", "queued",
+    "dropped", "executed", "timed_out", "allowed", "cancelled"
+};
+static const char* histogramNames[HISTOGRAM_COUNT] = { "queue", "method" };
+
+const char* EventCounters::getEventName(int event) {
+    return eventNames[event];
+}
+
+const char* EventCounters::getCounterName(int counter) {
+    return counterNames[counter];
+}
+
+const char* EventCounters::getHistogramName(int histogram) {
+    return histogramNames[histogram];
+}
+
+void EventCounters::enableTiming(bool enable) {
+    timing.store(enable, std::memory_order_relaxed);
+}
+
+// shards are pushed onto a lock-free list the first time a thread counts
+// and live until the plugin is unloaded, so the totals survive a thread
+CounterShard* EventCounters::getShard() {
+    static thread_local CounterShard* shard = nullptr;
+    if (!shard) {
+        // new only aligns to the fundamental alignment before C++17, so
+        // over-allocate and round up to the cache line ourselves
+        void* memory = malloc(sizeof(CounterShard) + COUNTER_CACHE_LINE - 1);
+        if (!memory)
+            throw std::bad_alloc();
+        uintptr_t aligned = ((uintptr_t)memory + COUNTER_CACHE_LINE - 1) & ~(uintptr_t)(COUNTER_CACHE_LINE - 1);
+        shard = new ((void*)aligned) CounterShard;
+        for (int event = 0; event < COUNTER_EVENT_COUNT; ++event) {
+            for (int counter = 0; counter < COUNTER_COUNT; ++counter)
+                shard->values[event][counter].store(0, std::memory_order_relaxed);
+            for (int histogram = 0; histogram < HISTOGRAM_COUNT; ++histogram) {
+                for (int bucket = 0; bucket < HISTOGRAM_BUCKET_COUNT; ++bucket)
+                    shard->buckets[event][histogram][bucket].store(0, std::memory_order_relaxed);
+                shard->sums[event][histogram].store(0, std::memory_order_relaxed);
+            }
+        }
+        shard->next = shards.load(std::memory_order_relaxed);
+        while (!shards.compare_exchange_weak(shard->next, shard,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed)) {}
+    }
+    return shard;
+}
+
+// only the owning thread writes a shard, so a plain load and store is enough
+void EventCounters::add(int event, int counter) {
+    if (event < 0 || event >= COUNTER_EVENT_COUNT)
+        return;
+    std::atomic<uint64_t>& value = getShard()->values[event][counter];
+    value.store(value.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+uint64_t EventCounters::get(int event, int counter) {
+    uint64_t value = 0;
+    if (event < 0 || event >= COUNTER_EVENT_COUNT)
+        return value;
+    for (CounterShard* shard = shards.load(std::memory_order_acquire); shard; shard = shard->next)
+        value += shard->values[event][counter].load(std::memory_order_relaxed);
+    return value;
+}
+
+void EventCounters::observe(int event, int histogram, uint64_t microseconds) {
+    if (event < 0 || event >= COUNTER_EVENT_COUNT)
+        return;
+    int bucket = 0;
+    while (bucket < HISTOGRAM_BUCKET_COUNT - 1 && microseconds > bucketBounds[bucket])
+        ++bucket;
+    CounterShard* shard = getShard();
+    std::atomic<uint64_t>& count = shard->buckets[event][histogram][bucket];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic<uint64_t>& sum = shard->sums[event][histogram];
+    sum.store(sum.load(std::memory_order_relaxed) + microseconds, std::memory_order_relaxed);
+}
+
+void EventCounters::snapshot(CounterSnapshot& totals) {
+    CounterSnapshot empty = {};
+    totals = empty;
+    for (CounterShard* shard = shards.load(std::memory_order_acquire); shard; shard = shard->next) {
+        for (int event = 0; event < COUNTER_EVENT_COUNT; ++event) {
+            for (int counter = 0; counter < COUNTER_COUNT; ++counter)
+                totals.values[event][counter] += shard->values[event][counter].load(std::memory_order_relaxed);
+            for (int histogram = 0; histogram < HISTOGRAM_COUNT; ++histogram) {
+                for (int bucket = 0; bucket < HISTOGRAM_BUCKET_COUNT; ++bucket)
+                    totals.buckets[event][histogram][bucket] += shard->buckets[event][histogram][bucket].load(std::memory_order_relaxed);
+                totals.sums[event][histogram] += shard->sums[event][histogram].load(std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+void EventCounters::read(std::vector<std::string>& names, std::vector<double>& values) {
+    CounterSnapshot totals;
+    snapshot(totals);
+
+    for (int event = 0; event <= COUNTER_EVENT_COUNT; ++event) {
+        for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+            uint64_t value = 0;
+            if (event < COUNTER_EVENT_COUNT) {
+                value = totals.values[event][counter];
+            } else {
+                for (int row = 0; row < COUNTER_EVENT_COUNT; ++row)
+                    value += totals.values[row][counter];
+            }
+            names.push_back(std::string(event < COUNTER_EVENT_COUNT ? eventNames[event] : "total") + "." + counterNames[counter]);
+            values.push_back((double)value);
+        }
+    }
+}
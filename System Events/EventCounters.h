@@ -0,0 +1,84 @@
+//
+//  EventCounters.h
+//  System Events
+//
+//  Counts events at each stage from the OS notification to the 4D method,
+//  and the time they spend queued and in the method. Every thread
+//  increments its own shard; reads add the shards up.
+//
+
+#ifndef EventCounters_h
+#define EventCounters_h
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define COUNTER_RECEIVED 0
+#define COUNTER_FILTERED 1
+#define COUNTER_DEBOUNCED 2
+#define COUNTER_RATE_LIMITED 3
+#define COUNTER_QUEUED 4
+#define COUNTER_DROPPED 5
+#define COUNTER_EXECUTED 6
+#define COUNTER_TIMED_OUT 7
+#define COUNTER_ALLOWED 8
+#define COUNTER_CANCELLED 9
+#define COUNTER_COUNT 10
+
+// one row per event type, SYSTEM_EVENT_COUNT in SystemEventsManager.h
+#define COUNTER_EVENT_COUNT 3
+
+#define HISTOGRAM_QUEUE 0
+#define HISTOGRAM_METHOD 1
+#define HISTOGRAM_COUNT 2
+// upper bounds in EventCounters.cpp, the last bucket is unbounded
+#define HISTOGRAM_BUCKET_COUNT 9
+
+#define COUNTER_CACHE_LINE 64
+
+// written by its owning thread only, summed by read()
+struct alignas(COUNTER_CACHE_LINE) CounterShard {
+    std::atomic<uint64_t> values[COUNTER_EVENT_COUNT][COUNTER_COUNT];
+    std::atomic<uint64_t> buckets[COUNTER_EVENT_COUNT][HISTOGRAM_COUNT][HISTOGRAM_BUCKET_COUNT];
+    // microseconds
+    std::atomic<uint64_t> sums[COUNTER_EVENT_COUNT][HISTOGRAM_COUNT];
+    CounterShard* next;
+};
+
+// buckets are per bucket, not cumulative
+struct CounterSnapshot {
+    uint64_t values[COUNTER_EVENT_COUNT][COUNTER_COUNT];
+    uint64_t buckets[COUNTER_EVENT_COUNT][HISTOGRAM_COUNT][HISTOGRAM_BUCKET_COUNT];
+    uint64_t sums[COUNTER_EVENT_COUNT][HISTOGRAM_COUNT];
+};
+
+class EventCounters {
+private:
+    static std::atomic<CounterShard*> shards;
+    static std::atomic<bool> timing;
+
+    static CounterShard* getShard();
+public:
+    // bucket upper bounds in microseconds
+    static const uint64_t bucketBounds[HISTOGRAM_BUCKET_COUNT - 1];
+
+    static const char* getEventName(int);
+    static const char* getCounterName(int);
+    static const char* getHistogramName(int);
+
+    // latencies are only measured while someone reads them
+    static void enableTiming(bool);
+    static bool isTiming() { return timing.load(std::memory_order_relaxed); }
+
+    static void add(int, int);
+    static void observe(int, int, uint64_t);
+    static void snapshot(CounterSnapshot&);
+    // one counter of one event type, summed over the shards
+    static uint64_t get(int, int);
+    // "<event>.<counter>" for each event type, then "total.<counter>"
+    static void read(std::vector<std::string>&, std::vector<double>&);
+};
+
+#endif /* EventCounters_h */
@@ -0,0 +1,155 @@
+//
+//  EventFilter.cpp
+//  System Events
+//
+
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+
+#include "4DPluginAPI.h"
+
+#include "EventFilter.h"
+
+static const char* fieldNames[FILTER_FIELD_COUNT] = { "suspended", "time", "weekday" };
+
+FilterContext::FilterContext(double suspended) {
+    time_t now = time(NULL);
+    struct tm local;
+#if VERSIONWIN
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    fields[FILTER_FIELD_SUSPENDED] = suspended;
+    fields[FILTER_FIELD_TIME] = local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec;
+    fields[FILTER_FIELD_WEEKDAY] = local.tm_wday + 1;
+}
+
+static void skipSpaces(const char*& p) {
+    while (*p && isspace((unsigned char)*p))
+        ++p;
+}
+
+static bool readWord(const char*& p, std::string& word) {
+    skipSpaces(p);
+    word.clear();
+    while (*p && (isalpha((unsigned char)*p) || *p == '_'))
+        word += (char)tolower((unsigned char)*p++);
+    return !word.empty();
+}
+
+static bool readOperator(const char*& p, int& op) {
+    skipSpaces(p);
+    if (p[0] == '<' && p[1] == '=') { op = FILTER_OP_LESS_EQUAL; p += 2; }
+    else if (p[0] == '>' && p[1] == '=') { op = FILTER_OP_GREATER_EQUAL; p += 2; }
+    else if (p[0] == '!' && p[1] == '=') { op = FILTER_OP_NOT_EQUAL; p += 2; }
+    else if (p[0] == '=' && p[1] == '=') { op = FILTER_OP_EQUAL; p += 2; }
+    else if (p[0] == '<') { op = FILTER_OP_LESS; ++p; }
+    else if (p[0] == '>') { op = FILTER_OP_GREATER; ++p; }
+    else if (p[0] == '=') { op = FILTER_OP_EQUAL; ++p; }
+    else return false;
+    return true;
+}
+
+// digits with an optional fraction, read the same way whatever the C locale;
+// no sign, exponent, hex or nan/inf spellings
+static bool readDecimal(const char*& p, double& value, bool fraction) {
+    const char* start = p;
+    value = 0;
+    while (isdigit((unsigned char)*p))
+        value = value * 10 + (*p++ - '0');
+    if (fraction && *p == '.' && isdigit((unsigned char)p[1])) {
+        double scale = 1;
+        for (++p; isdigit((unsigned char)*p); ++p) {
+            scale /= 10;
+            value += (*p - '0') * scale;
+        }
+    }
+    return p != start && isfinite(value);
+}
+
+// a number, or a time of day written HH:MM[:SS] which reads as seconds
+static bool readValue(const char*& p, double& value) {
+    skipSpaces(p);
+    if (!readDecimal(p, value, true))
+        return false;
+    for (int part = 0; part < 2 && *p == ':' && isdigit((unsigned char)p[1]); ++part) {
+        double units;
+        ++p;
+        if (!readDecimal(p, units, false))
+            return false;
+        value = value * 60 + units;
+        if (part == 0 && *p != ':')
+            value *= 60;
+    }
+    return isfinite(value);
+}
+
+bool EventFilter::compile(const std::string& text) {
+    std::vector<FilterInstruction> compiled;
+    const char* p = text.c_str();
+    skipSpaces(p);
+
+    std::string word;
+    while (*p) {
+        FilterInstruction instruction;
+        if (!readWord(p, word))
+            return false;
+        instruction.field = -1;
+        for (int i = 0; i < FILTER_FIELD_COUNT; ++i) {
+            if (word == fieldNames[i])
+                instruction.field = i;
+        }
+        if (instruction.field < 0 || !readOperator(p, instruction.op) || !readValue(p, instruction.value))
+            return false;
+        compiled.push_back(instruction);
+
+        skipSpaces(p);
+        if (!*p)
+            break;
+        if (!readWord(p, word))
+            return false;
+        if (word == "or") {
+            FilterInstruction separator = { -1, FILTER_OP_OR, 0 };
+            compiled.push_back(separator);
+        } else if (word != "and") {
+            return false;
+        }
+        skipSpaces(p);
+        if (!*p)
+            return false;
+    }
+
+    program.swap(compiled);
+    return true;
+}
+
+bool EventFilter::matches(const FilterContext& context) const {
+    if (program.empty())
+        return true;
+
+    bool conjunction = true;
+    for (size_t i = 0; i < program.size(); ++i) {
+        const FilterInstruction& instruction = program[i];
+        if (instruction.op == FILTER_OP_OR) {
+            if (conjunction)
+                return true;
+            conjunction = true;
+            continue;
+        }
+        if (!conjunction)
+            continue;
+
+        double field = context.fields[instruction.field];
+        switch (instruction.op) {
+            case FILTER_OP_LESS: conjunction = field < instruction.value; break;
+            case FILTER_OP_LESS_EQUAL: conjunction = field <= instruction.value; break;
+            case FILTER_OP_GREATER: conjunction = field > instruction.value; break;
+            case FILTER_OP_GREATER_EQUAL: conjunction = field >= instruction.value; break;
+            case FILTER_OP_EQUAL: conjunction = field == instruction.value; break;
+            case FILTER_OP_NOT_EQUAL: conjunction = field != instruction.value; break;
+        }
+    }
+    return conjunction;
+}
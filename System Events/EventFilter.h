@@ -0,0 +1,55 @@
+//
+//  EventFilter.h
+//  System Events
+//
+//  Predicates evaluated on the notification thread before an event is
+//  queued for 4D, e.g. "suspended >= 60 and time >= 08:00 or weekday = 1".
+//  "and" binds tighter than "or"; the text is compiled once into a flat
+//  program of comparisons.
+//
+
+#ifndef EventFilter_h
+#define EventFilter_h
+
+#include <string>
+#include <vector>
+
+// fields an event exposes to filters
+#define FILTER_FIELD_SUSPENDED 0    // seconds suspended before a wake, -1 if unknown
+#define FILTER_FIELD_TIME 1         // seconds since local midnight
+#define FILTER_FIELD_WEEKDAY 2      // 1 (Sunday) to 7, as Day number in 4D
+#define FILTER_FIELD_COUNT 3
+
+#define FILTER_OP_LESS 0
+#define FILTER_OP_LESS_EQUAL 1
+#define FILTER_OP_GREATER 2
+#define FILTER_OP_GREATER_EQUAL 3
+#define FILTER_OP_EQUAL 4
+#define FILTER_OP_NOT_EQUAL 5
+// ends a conjunction; the program matches if any conjunction holds
+#define FILTER_OP_OR 6
+
+struct FilterInstruction {
+    int field;
+    int op;
+    double value;
+};
+
+struct FilterContext {
+    double fields[FILTER_FIELD_COUNT];
+
+    // fills time and weekday from the local clock
+    FilterContext(double suspended);
+};
+
+class EventFilter {
+private:
+    std::vector<FilterInstruction> program;
+public:
+    // an empty filter matches every event
+    bool compile(const std::string&);
+    bool matches(const FilterContext&) const;
+    bool empty() const { return program.empty(); }
+};
+
+#endif /* EventFilter_h */
@@ -0,0 +1,60 @@
+//
+//  EventRing.cpp
+//  System Events
+//
+
+#include <chrono>
+
+#include "EventRing.h"
+
+EventSlot EventRing::slots[EVENT_RING_SIZE];
+std::atomic<uint64_t> EventRing::published(0);
+
+void EventRing::publish(int event, double parameter) {
+    uint64_t sequence = published.load(std::memory_order_relaxed) + 1;
+    EventSlot& slot = slots[sequence % EVENT_RING_SIZE];
+
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.event.store(event, std::memory_order_relaxed);
+    slot.parameter.store(parameter, std::memory_order_relaxed);
+    slot.timestamp.store(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count() / 1000.0, std::memory_order_relaxed);
+    slot.sequence.store(sequence, std::memory_order_release);
+
+    published.store(sequence, std::memory_order_release);
+}
+
+uint64_t EventRing::next(uint64_t cursor, std::vector<EventRecord>& records, bool& overrun) {
+    uint64_t head = published.load(std::memory_order_acquire);
+    overrun = false;
+    if (cursor > head)
+        cursor = head;
+    if (head - cursor > EVENT_RING_SIZE) {
+        overrun = true;
+        cursor = head - EVENT_RING_SIZE;
+    }
+
+    for (uint64_t sequence = cursor + 1; sequence <= head; ++sequence) {
+        EventSlot& slot = slots[sequence % EVENT_RING_SIZE];
+        EventRecord record;
+        record.sequence = slot.sequence.load(std::memory_order_acquire);
+        record.event = slot.event.load(std::memory_order_relaxed);
+        record.parameter = slot.parameter.load(std::memory_order_relaxed);
+        record.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // the writer lapped us while we were copying
+        if (record.sequence != sequence || slot.sequence.load(std::memory_order_relaxed) != sequence) {
+            overrun = true;
+            continue;
+        }
+        records.push_back(record);
+    }
+    return head;
+}
+
+uint64_t EventRing::toCursor(double value) {
+    if (!(value > 0))
+        return 0;
+    return value < EVENT_RING_MAX_CURSOR ? (uint64_t)value : (uint64_t)EVENT_RING_MAX_CURSOR;
+}
@@ -0,0 +1,53 @@
+//
+//  EventRing.h
+//  System Events
+//
+//  Broadcast history of the latest events. The notification thread is the
+//  only writer; any number of readers each keep their own cursor and never
+//  block the writer or each other.
+//
+
+#ifndef EventRing_h
+#define EventRing_h
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+#define EVENT_RING_SIZE 256
+// cursors go through 4D as reals, which hold every integer up to 2^53
+#define EVENT_RING_MAX_CURSOR 9007199254740992.0
+
+struct EventRecord {
+    uint64_t sequence;
+    int event;
+    double parameter;
+    double timestamp;
+};
+
+// sequence is 0 while the slot is being written, then the sequence of the
+// record it holds; a reader that sees the same sequence before and after
+// copying the fields has a consistent record
+struct EventSlot {
+    std::atomic<uint64_t> sequence;
+    std::atomic<int> event;
+    std::atomic<double> parameter;
+    std::atomic<double> timestamp;
+};
+
+class EventRing {
+private:
+    static EventSlot slots[EVENT_RING_SIZE];
+    // sequence of the last published record, records start at 1
+    static std::atomic<uint64_t> published;
+public:
+    static void publish(int, double);
+    // appends the records after cursor and returns the new cursor; overrun
+    // is set when records were overwritten before they could be read
+    static uint64_t next(uint64_t, std::vector<EventRecord>&, bool&);
+    // the cursor a real from 4D stands for; one that is not a positive
+    // number reads from the oldest record kept
+    static uint64_t toCursor(double);
+};
+
+#endif /* EventRing_h */
@@ -0,0 +1,161 @@
+//
+//  EventTrace.cpp
+//  System Events
+//
+
+#include <chrono>
+#include <stdio.h>
+
+#include "4DPluginAPI.h"
+
+#if VERSIONWIN
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "EventTrace.h"
+#include "FileUtils.h"
+
+std::atomic<bool> EventTrace::enabled(false);
+std::atomic<TraceBuffer*> EventTrace::buffers(nullptr);
+
+static const char* eventNames[] = { "sleep", "wake", "shutdown" };
+
+static unsigned long currentThreadID() {
+#if VERSIONWIN
+    return GetCurrentThreadId();
+#else
+    uint64_t tid = 0;
+    pthread_threadid_np(NULL, &tid);
+    return (unsigned long)tid;
+#endif
+}
+
+// gives the buffer back when its thread exits, so the notification thread
+// started again after a stop picks up the one its predecessor used
+struct TraceBufferOwner {
+    TraceBuffer* buffer;
+
+    TraceBufferOwner() : buffer(nullptr) {}
+    ~TraceBufferOwner() {
+        if (buffer)
+            buffer->owned.store(false, std::memory_order_release);
+    }
+};
+
+// buffers are pushed onto a lock-free list the first time they are needed
+// and never freed, so neither flush() nor a thread still recording races a
+// free; records left by an exited thread are reported under the id of the
+// next owner
+TraceBuffer* EventTrace::getBuffer() {
+    static thread_local TraceBufferOwner owner;
+    if (owner.buffer)
+        return owner.buffer;
+
+    TraceBuffer* buffer = nullptr;
+    for (TraceBuffer* free = buffers.load(std::memory_order_acquire); free && !buffer; free = free->next) {
+        bool owned = false;
+        if (free->owned.compare_exchange_strong(owned, true, std::memory_order_acquire))
+            buffer = free;
+    }
+    if (!buffer) {
+        buffer = new TraceBuffer;
+        buffer->owned.store(true, std::memory_order_relaxed);
+        buffer->head.store(0, std::memory_order_relaxed);
+        for (int i = 0; i < TRACE_BUFFER_SIZE; ++i)
+            buffer->records[i].sequence.store(0, std::memory_order_relaxed);
+        buffer->next = buffers.load(std::memory_order_relaxed);
+        while (!buffers.compare_exchange_weak(buffer->next, buffer,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed)) {}
+    }
+    buffer->threadID.store(currentThreadID(), std::memory_order_relaxed);
+    owner.buffer = buffer;
+    return buffer;
+}
+
+void EventTrace::record(const char* name, int event, uint64_t begin, uint64_t duration, char phase) {
+    TraceBuffer* buffer = getBuffer();
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    TraceRecord& r = buffer->records[head % TRACE_BUFFER_SIZE];
+    r.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    r.name.store(name, std::memory_order_relaxed);
+    r.event.store(event, std::memory_order_relaxed);
+    r.begin.store(begin, std::memory_order_relaxed);
+    r.duration.store(duration, std::memory_order_relaxed);
+    r.phase.store(phase, std::memory_order_relaxed);
+    r.sequence.store(head + 1, std::memory_order_release);
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void EventTrace::enable(bool enable) {
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+uint64_t EventTrace::now() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void EventTrace::instant(const char* name, int event) {
+    if (isEnabled())
+        record(name, event, now(), 0, 'i');
+}
+
+// closes a span opened at begin (a value returned by now())
+void EventTrace::span(const char* name, int event, uint64_t begin) {
+    if (isEnabled() && begin) {
+        uint64_t end = now();
+        record(name, event, begin, end > begin ? end - begin : 0, 'X');
+    }
+}
+
+bool EventTrace::flush(const char* path) {
+    FILE* file = openUTF8File(path, "wb");
+    if (!file)
+        return false;
+
+    fputs("{\"traceEvents\":[", file);
+    bool first = true;
+    for (TraceBuffer* buffer = buffers.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t tail = head > TRACE_BUFFER_SIZE ? head - TRACE_BUFFER_SIZE : 0;
+        unsigned long threadID = buffer->threadID.load(std::memory_order_relaxed);
+        for (uint64_t i = tail; i < head; ++i) {
+            TraceRecord& slot = buffer->records[i % TRACE_BUFFER_SIZE];
+            if (slot.sequence.load(std::memory_order_acquire) != i + 1)
+                continue;
+            const char* name = slot.name.load(std::memory_order_relaxed);
+            int event = slot.event.load(std::memory_order_relaxed);
+            uint64_t begin = slot.begin.load(std::memory_order_relaxed);
+            uint64_t duration = slot.duration.load(std::memory_order_relaxed);
+            char phase = slot.phase.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // the owning thread reused the slot while we were copying
+            if (slot.sequence.load(std::memory_order_relaxed) != i + 1)
+                continue;
+            const char* category = (event >= 0 && event < (int)(sizeof(eventNames) / sizeof(eventNames[0])))
+                ? eventNames[event] : "plugin";
+            fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,",
+                    first ? "" : ",", name, category, phase, (unsigned long long)begin);
+            if (phase == 'X')
+                fprintf(file, "\"dur\":%llu,", (unsigned long long)duration);
+            else
+                fputs("\"s\":\"t\",", file);
+            fprintf(file, "\"pid\":1,\"tid\":%lu}", threadID);
+            first = false;
+        }
+    }
+    fputs("\n],\"displayTimeUnit\":\"ms\"}\n", file);
+
+    bool ok = ferror(file) == 0;
+    return (fclose(file) == 0) && ok;
+}
+
+// the callback process can outlive DeinitPlugin and still be recording, so
+// the buffers are left in place; a later load reuses them
+void EventTrace::destroy() {
+    enabled.store(false, std::memory_order_relaxed);
+}
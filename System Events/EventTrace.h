@@ -0,0 +1,61 @@
+//
+//  EventTrace.h
+//  System Events
+//
+//  Records the dispatch timeline of system events and writes it out
+//  in the Chrome Trace Event format (chrome://tracing, ui.perfetto.dev).
+//
+
+#ifndef EventTrace_h
+#define EventTrace_h
+
+#include <atomic>
+#include <stdint.h>
+
+// records kept per thread; older ones are overwritten
+#define TRACE_BUFFER_SIZE 4096
+
+// sequence is 0 while the record is being written, then its position in
+// the buffer plus one; flush() skips a record whose sequence changed while
+// it was copying the fields
+struct TraceRecord {
+    std::atomic<uint64_t> sequence;
+    std::atomic<const char*> name;
+    std::atomic<uint64_t> begin;
+    std::atomic<uint64_t> duration;
+    std::atomic<int> event;
+    std::atomic<char> phase;
+};
+
+// written by its owning thread only, read by flush(); a buffer whose
+// thread has exited is handed to the next thread that needs one
+struct TraceBuffer {
+    std::atomic<unsigned long> threadID;
+    std::atomic<bool> owned;
+    std::atomic<uint64_t> head;
+    TraceRecord records[TRACE_BUFFER_SIZE];
+    TraceBuffer* next;
+};
+
+class EventTrace {
+private:
+    static std::atomic<bool> enabled;
+    static std::atomic<TraceBuffer*> buffers;
+
+    static TraceBuffer* getBuffer();
+    static void record(const char*, int, uint64_t, uint64_t, char);
+public:
+    static void enable(bool);
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    static uint64_t now();
+
+    static void instant(const char*, int);
+    static void span(const char*, int, uint64_t);
+
+    static bool flush(const char*);
+    // stops recording; the buffers stay allocated
+    static void destroy();
+};
+
+#endif /* EventTrace_h */
@@ -0,0 +1,51 @@
+//
+//  FileUtils.cpp
+//  System Events
+//
+
+#include <string>
+
+#include "4DPluginAPI.h"
+
+#if VERSIONWIN
+#include <Windows.h>
+#endif
+
+#include "FileUtils.h"
+
+#if VERSIONWIN
+static std::wstring widen(const char* text) {
+    int len = MultiByteToWideChar(CP_UTF8, 0, text, -1, NULL, 0);
+    if (len <= 0)
+        return std::wstring();
+    std::wstring wide(len, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text, -1, &wide[0], len);
+    return wide;
+}
+#endif
+
+FILE* openUTF8File(const char* path, const char* mode) {
+#if VERSIONWIN
+    std::wstring wpath = widen(path);
+    std::wstring wmode = widen(mode);
+    if (wpath.empty() || wmode.empty())
+        return NULL;
+    return _wfopen(wpath.c_str(), wmode.c_str());
+#else
+    return fopen(path, mode);
+#endif
+}
+
+// rename() on Windows fails when the destination exists, so readers could
+// see the file missing between a delete and the rename
+bool renameUTF8File(const char* from, const char* to) {
+#if VERSIONWIN
+    std::wstring wfrom = widen(from);
+    std::wstring wto = widen(to);
+    if (wfrom.empty() || wto.empty())
+        return false;
+    return MoveFileExW(wfrom.c_str(), wto.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
@@ -0,0 +1,18 @@
+//
+//  FileUtils.h
+//  System Events
+//
+//  File access by UTF-8 path, which Windows only offers through the wide
+//  character functions.
+//
+
+#ifndef FileUtils_h
+#define FileUtils_h
+
+#include <stdio.h>
+
+FILE* openUTF8File(const char*, const char*);
+// replaces the destination if it exists
+bool renameUTF8File(const char*, const char*);
+
+#endif /* FileUtils_h */
@@ -0,0 +1,141 @@
+//
+//  MetricsExporter.cpp
+//  System Events
+//
+
+#include <chrono>
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "MetricsExporter.h"
+#include "EventCounters.h"
+#include "FileUtils.h"
+#include "SystemEventsManager.h"
+
+std::mutex MetricsExporter::controlMutex;
+std::mutex MetricsExporter::stateMutex;
+std::condition_variable MetricsExporter::stopRequested;
+std::thread MetricsExporter::thread;
+bool MetricsExporter::running = false;
+
+static void append(std::string& text, const char* format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (len > 0)
+        text.append(line, len < (int)sizeof(line) ? len : sizeof(line) - 1);
+}
+
+static void appendHistogram(std::string& text, const CounterSnapshot& totals, int histogram, const char* help) {
+    const char* name = EventCounters::getHistogramName(histogram);
+    append(text, "# HELP system_events_%s_seconds %s\n", name, help);
+    append(text, "# TYPE system_events_%s_seconds histogram\n", name);
+    for (int event = 0; event < COUNTER_EVENT_COUNT; ++event) {
+        const char* eventName = EventCounters::getEventName(event);
+        uint64_t count = 0;
+        for (int bucket = 0; bucket < HISTOGRAM_BUCKET_COUNT; ++bucket) {
+            count += totals.buckets[event][histogram][bucket];
+            if (bucket < HISTOGRAM_BUCKET_COUNT - 1)
+                append(text, "system_events_%s_seconds_bucket{event=\"%s\",le=\"%g\"} %llu\n", name, eventName,
+                       EventCounters::bucketBounds[bucket] / 1000000.0, (unsigned long long)count);
+            else
+                append(text, "system_events_%s_seconds_bucket{event=\"%s\",le=\"+Inf\"} %llu\n", name, eventName,
+                       (unsigned long long)count);
+        }
+        append(text, "system_events_%s_seconds_sum{event=\"%s\"} %.6f\n", name, eventName,
+               totals.sums[event][histogram] / 1000000.0);
+        append(text, "system_events_%s_seconds_count{event=\"%s\"} %llu\n", name, eventName, (unsigned long long)count);
+    }
+}
+
+// the collector may read at any time, so the file is written beside the
+// target and renamed over it once complete
+bool MetricsExporter::write(const std::string& path) {
+    CounterSnapshot totals;
+    EventCounters::snapshot(totals);
+
+    std::string text;
+    text.reserve(8192);
+    append(text, "# HELP system_events_total Events counted at each dispatch stage.\n");
+    append(text, "# TYPE system_events_total counter\n");
+    for (int event = 0; event < COUNTER_EVENT_COUNT; ++event) {
+        for (int counter = 0; counter < COUNTER_COUNT; ++counter)
+            append(text, "system_events_total{event=\"%s\",stage=\"%s\"} %llu\n",
+                   EventCounters::getEventName(event), EventCounters::getCounterName(counter),
+                   (unsigned long long)totals.values[event][counter]);
+    }
+    appendHistogram(text, totals, HISTOGRAM_QUEUE, "Time from an event being queued to its method starting.");
+    appendHistogram(text, totals, HISTOGRAM_METHOD, "Time spent in the 4D method of an event.");
+
+    append(text, "# HELP system_events_registered Whether a method is registered for the event.\n");
+    append(text, "# TYPE system_events_registered gauge\n");
+    for (int event = 0; event < SYSTEM_EVENT_COUNT; ++event)
+        append(text, "system_events_registered{event=\"%s\"} %d\n", EventCounters::getEventName(event),
+               SystemEventsManager::getEvent(event).isRegistered() ? 1 : 0);
+    append(text, "# HELP system_events_prevented Whether the event is currently being prevented.\n");
+    append(text, "# TYPE system_events_prevented gauge\n");
+    for (int event = 0; event < SYSTEM_EVENT_COUNT; ++event)
+        append(text, "system_events_prevented{event=\"%s\"} %d\n", EventCounters::getEventName(event),
+               SystemEventsManager::getEvent(event).isPrevented() ? 1 : 0);
+    append(text, "# HELP system_events_loop_running Whether the notification thread is listening.\n");
+    append(text, "# TYPE system_events_loop_running gauge\n");
+    append(text, "system_events_loop_running %d\n", SystemEventsManager::getLoopState() == LOOP_RUNNING ? 1 : 0);
+    append(text, "# HELP system_events_last_suspend_seconds Length of the last sleep, -1 before the first wake.\n");
+    append(text, "# TYPE system_events_last_suspend_seconds gauge\n");
+    append(text, "system_events_last_suspend_seconds %.3f\n", SystemEventsManager::getSuspendedDuration());
+
+    std::string temporary = path + ".tmp";
+    FILE* file = openUTF8File(temporary.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = (fclose(file) == 0) && ok;
+    return ok && renameUTF8File(temporary.c_str(), path.c_str());
+}
+
+void MetricsExporter::run(std::string path, unsigned int interval) {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    while (running) {
+        if (stopRequested.wait_for(lock, std::chrono::seconds(interval), [] { return !running; }))
+            break;
+        lock.unlock();
+        write(path);
+        lock.lock();
+    }
+}
+
+bool MetricsExporter::start(const std::string& path, unsigned int interval) {
+    std::lock_guard<std::mutex> control(controlMutex);
+    stopThread();
+
+    EventCounters::enableTiming(true);
+    if (!write(path)) {
+        EventCounters::enableTiming(false);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(stateMutex);
+    running = true;
+    thread = std::thread(run, path, interval);
+    return true;
+}
+
+// latencies stop being measured once nothing exports them
+void MetricsExporter::stopThread() {
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if (!running)
+            return;
+        running = false;
+    }
+    stopRequested.notify_all();
+    thread.join();
+    EventCounters::enableTiming(false);
+}
+
+void MetricsExporter::stop() {
+    std::lock_guard<std::mutex> control(controlMutex);
+    stopThread();
+}
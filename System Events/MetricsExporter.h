@@ -0,0 +1,36 @@
+//
+//  MetricsExporter.h
+//  System Events
+//
+//  Periodically writes the event counters, callback latencies and power
+//  state to a file in the Prometheus text format, for node_exporter's
+//  textfile collector to pick up.
+//
+
+#ifndef MetricsExporter_h
+#define MetricsExporter_h
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class MetricsExporter {
+private:
+    static std::mutex controlMutex;
+    static std::mutex stateMutex;
+    static std::condition_variable stopRequested;
+    static std::thread thread;
+    static bool running;
+
+    static void run(std::string, unsigned int);
+    static void stopThread();
+    static bool write(const std::string&);
+public:
+    // writes once before returning so a bad path is reported to the caller;
+    // restarts the exporter if it is already running
+    static bool start(const std::string&, unsigned int);
+    static void stop();
+};
+
+#endif /* MetricsExporter_h */
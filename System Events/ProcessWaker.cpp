@@ -0,0 +1,83 @@
+//
+//  ProcessWaker.cpp
+//  System Events
+//
+
+#include <chrono>
+
+#include "ProcessWaker.h"
+
+std::mutex ProcessWaker::mutex;
+std::condition_variable ProcessWaker::changed;
+std::thread ProcessWaker::thread;
+bool ProcessWaker::running = false;
+std::vector<WakeRequest> ProcessWaker::requests;
+
+void ProcessWaker::park(ProcessPark& park, PA_long32 ticks, const std::function<bool()>& ready) {
+    // announce the park before the last look at the condition; a waker
+    // either sees it or has made the condition true already
+    park.parked.store(true);
+    if (!ready())
+        PA_PutProcessToSleep(park.process.load(), ticks);
+    park.parked.store(false);
+
+    // the acknowledgement: retries for this park stop at once
+    std::lock_guard<std::mutex> lock(mutex);
+    changed.notify_all();
+}
+
+void ProcessWaker::wake(ProcessPark& park) {
+    if (!park.parked.load())
+        return;
+    PA_UnfreezeProcess(park.process.load());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < requests.size(); ++i) {
+        if (requests[i].park == &park) {
+            requests[i].attempts = 0;
+            return;
+        }
+    }
+    WakeRequest request = { &park, 0 };
+    requests.push_back(request);
+    if (!running) {
+        if (thread.joinable())
+            thread.join();
+        running = true;
+        thread = std::thread(run);
+    }
+    changed.notify_all();
+}
+
+// unfreezes every requested park once per ms until its process has left
+// it; the thread ends when there is nothing left to wake
+void ProcessWaker::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running && !requests.empty()) {
+        changed.wait_for(lock, std::chrono::milliseconds(1));
+        size_t kept = 0;
+        for (size_t i = 0; i < requests.size(); ++i) {
+            WakeRequest& request = requests[i];
+            if (!request.park->parked.load() || request.attempts >= PROCESS_WAKE_ATTEMPTS)
+                continue;
+            ++request.attempts;
+            PA_UnfreezeProcess(request.park->process.load());
+            requests[kept++] = request;
+        }
+        requests.resize(kept);
+    }
+    running = false;
+}
+
+void ProcessWaker::stop() {
+    std::thread finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+        requests.clear();
+        finished.swap(thread);
+    }
+    changed.notify_all();
+    if (finished.joinable())
+        finished.join();
+}
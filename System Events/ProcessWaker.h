@@ -0,0 +1,58 @@
+//
+//  ProcessWaker.h
+//  System Events
+//
+//  Wakes 4D processes parked with PA_PutProcessToSleep. The host does not
+//  latch an unfreeze that lands between a process's last look at its
+//  condition and the start of its sleep, so a parked process acknowledges
+//  the wake by leaving the park, and a thread of its own keeps unfreezing
+//  it until it does; whoever wakes never blocks on it.
+//
+
+#ifndef ProcessWaker_h
+#define ProcessWaker_h
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "4DPluginAPI.h"
+
+// unfreezes sent, one per ms, before a park that is never left (its process
+// died parked) is given up
+#define PROCESS_WAKE_ATTEMPTS 16
+
+// the park's owner sets process before its first park
+struct ProcessPark {
+    std::atomic<long> process;
+    std::atomic<bool> parked;
+};
+
+// a park still waiting for its process to leave, and the unfreezes sent
+struct WakeRequest {
+    ProcessPark* park;
+    int attempts;
+};
+
+class ProcessWaker {
+private:
+    static std::mutex mutex;
+    static std::condition_variable changed;
+    static std::thread thread;
+    static bool running;
+    static std::vector<WakeRequest> requests;
+
+    static void run();
+public:
+    // parks the calling process for up to ticks unless ready() holds once
+    // the park is announced; a wake in between is not lost
+    static void park(ProcessPark&, PA_long32, const std::function<bool()>&);
+    // call after making the parked process ready; never blocks
+    static void wake(ProcessPark&);
+    static void stop();
+};
+
+#endif /* ProcessWaker_h */
@@ -6,6 +6,8 @@
 //
 //
 
+#include <chrono>
+#include <float.h>
 #include <thread>
 #include <vector>
 
@@ -16,54 +18,115 @@
 #else
 #include <IOKit/pwr_mgt/IOPMLib.h>
 #include <IOKit/IOMessage.h>
+#include <mach/mach_time.h>
+#include <sys/sysctl.h>
+#include <sys/time.h>
 #endif
 
 #include "SystemEventsManager.h"
 #include "Event.h"
-
-bool SystemEventsManager::systemEventLoopRunning;
-bool SystemEventsManager::callbackLoopRunning;
-long SystemEventsManager::callbackMethodID;
-long SystemEventsManager::callbackProcessID;
-std::vector<Event> SystemEventsManager::events;
+#include "EventTrace.h"
+#include "EventRing.h"
+#include "EventCounters.h"
+#include "MetricsExporter.h"
+
+std::atomic<int> SystemEventsManager::loopState(LOOP_STOPPED);
+std::thread SystemEventsManager::loopThread;
+std::mutex SystemEventsManager::loopMutex;
+std::mutex SystemEventsManager::loopStateMutex;
+std::condition_variable SystemEventsManager::loopStateChanged;
+std::atomic<bool> SystemEventsManager::callbackLoopRunning(false);
+std::atomic<bool> SystemEventsManager::loopStopRequested(false);
+ProcessPark SystemEventsManager::callbackPark;
+CallbackItem SystemEventsManager::callbackQueue[CALLBACK_QUEUE_SIZE];
+std::atomic<uint64_t> SystemEventsManager::postedSequence(0);
+std::atomic<uint64_t> SystemEventsManager::consumedSequence(0);
+std::atomic<int64_t> SystemEventsManager::sleepMark(-1);
+std::atomic<int64_t> SystemEventsManager::suspendedDuration(-1);
+std::mutex SystemEventsManager::completionMutex;
+std::condition_variable SystemEventsManager::callbackCompleted;
+Event SystemEventsManager::events[SYSTEM_EVENT_COUNT];
+std::mutex SystemEventsManager::subscriptionMutex;
+std::vector<RetiredSubscription> SystemEventsManager::retiredSubscriptions;
+std::atomic<uint64_t> SystemEventsManager::subscriptionEpoch(0);
+std::mutex SystemEventsManager::methodIDsMutex;
+std::map<CUTF16String, long> SystemEventsManager::methodIDs;
+std::mutex SystemEventsManager::preventMutex;
+std::map<long, PreventToken> SystemEventsManager::preventTokens;
+long SystemEventsManager::nextPreventToken;
+long SystemEventsManager::legacyPreventTokens[SYSTEM_EVENT_COUNT];
+std::mutex SystemEventsManager::timerMutex;
+TimerWheel SystemEventsManager::timers;
+WaiterSlot SystemEventsManager::waiters[WAITER_SLOTS];
+std::atomic<int> SystemEventsManager::waiterCount(0);
 
 #if VERSIONWIN
 HWND hWin;
 
+// posted by applyPrevention and armTimers, handled on the notification thread
+#define WM_SYSTEM_EVENTS_PREVENT (WM_APP + 1)
+#define WM_SYSTEM_EVENTS_TIMER (WM_APP + 2)
+
+#define SYSTEM_EVENTS_TIMER_ID 1
+
 LRESULT CALLBACK systemEventCallback(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
-	Event event;
+	Event* event;
 	switch (uMsg)
 	{
 	case WM_CREATE:
 		return false;
 
 	case WM_DESTROY:
+		PostQuitMessage(0);
+		return false;
+
+	case WM_SYSTEM_EVENTS_PREVENT:
+		if (SystemEventsManager::getEvent(SYSTEM_SLEEP).isPrevented())
+			SetThreadExecutionState(ES_CONTINUOUS | ES_SYSTEM_REQUIRED);
+		else
+			SetThreadExecutionState(ES_CONTINUOUS);
+		return false;
+
+	case WM_SYSTEM_EVENTS_TIMER:
+		SetTimer(hwnd, SYSTEM_EVENTS_TIMER_ID, TIMER_TICK_MS, NULL);
+		return false;
+
+	case WM_TIMER:
+		if (wParam == SYSTEM_EVENTS_TIMER_ID)
+			SystemEventsManager::advanceTimers();
 		return false;
 
 	case WM_QUERYENDSESSION:
-		event = SystemEventsManager::getEvent(SYSTEM_SHUTDOWN);
+		EventTrace::instant("notify", SYSTEM_SHUTDOWN);
+		EventCounters::add(SYSTEM_SHUTDOWN, COUNTER_RECEIVED);
+		event = &SystemEventsManager::getEvent(SYSTEM_SHUTDOWN);
+		
+		// the method may call shutdownPrevent before its deadline
+		if (!event->isPrevented())
+			SystemEventsManager::dispatchEvent(SYSTEM_SHUTDOWN);
 		
-		if (event.isPrevented()) {
+		if (event->isPrevented()) {
+			EventTrace::instant("cancel", SYSTEM_SHUTDOWN);
+			EventCounters::add(SYSTEM_SHUTDOWN, COUNTER_CANCELLED);
 			return false;
 		} else {
-			if (event.isRegistered())
-				SystemEventsManager::executeCallback(event.getCallback());
+			EventTrace::instant("allow", SYSTEM_SHUTDOWN);
+			EventCounters::add(SYSTEM_SHUTDOWN, COUNTER_ALLOWED);
 			return true;
 		}
 
 	case WM_POWERBROADCAST:
 		switch (wParam) {
 		case PBT_APMSUSPEND:
-			event = SystemEventsManager::getEvent(SYSTEM_SLEEP);
-
-			if (event.isRegistered())
-				SystemEventsManager::executeCallback(event.getCallback());
+			EventTrace::instant("notify", SYSTEM_SLEEP);
+			EventCounters::add(SYSTEM_SLEEP, COUNTER_RECEIVED);
+			SystemEventsManager::markSleep();
+			SystemEventsManager::dispatchEvent(SYSTEM_SLEEP);
 			break;
 		case PBT_APMRESUMEAUTOMATIC:
-			event = SystemEventsManager::getEvent(SYSTEM_WAKE);
-
-			if (event.isRegistered())
-				SystemEventsManager::executeCallback(event.getCallback());
+			EventTrace::instant("notify", SYSTEM_WAKE);
+			EventCounters::add(SYSTEM_WAKE, COUNTER_RECEIVED);
+			SystemEventsManager::dispatchEvent(SYSTEM_WAKE, 1, SystemEventsManager::markWake());
 			break;
 		default:
 			break;
@@ -83,7 +146,18 @@ void SystemEventsManager::runLoop() {
 	RegisterClass(&wc);
 	hWin = CreateWindow(name, name, 0, 0, 0, 0, 0, NULL, NULL, NULL, 0);
 
-	systemEventLoopRunning = true;
+	if (hWin == NULL) {
+		setLoopState(LOOP_STOPPED);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(timerMutex);
+		if (!timers.empty())
+			armTimers(true);
+	}
+
+	setLoopState(LOOP_RUNNING);
 	MSG msg = { 0 };
 	BOOL status;
 
@@ -99,52 +173,95 @@ void SystemEventsManager::runLoop() {
 			}
 		}
 	} catch (...) {}
-    stopLoop();
-}
 
-void SystemEventsManager::stopLoop(bool forceStop) {
-	if (systemEventLoopRunning && (forceStop || allEventsDisabled())) {
+	if (IsWindow(hWin)) {
+		KillTimer(hWin, SYSTEM_EVENTS_TIMER_ID);
 		DestroyWindow(hWin);
-		systemEventLoopRunning = false;
 	}
+	hWin = NULL;
+	SetThreadExecutionState(ES_CONTINUOUS);
+}
+
+// WM_CLOSE is queued on the loop thread, which destroys the window and quits
+void SystemEventsManager::wakeLoop() {
+	PostMessage(hWin, WM_CLOSE, 0, 0);
+}
+
+// GetTickCount64 keeps counting while the machine sleeps, the unbiased
+// interrupt time does not; their difference only grows across a suspend
+int64_t SystemEventsManager::suspendedClock() {
+	ULONGLONG awake = 0;
+	QueryUnbiasedInterruptTime(&awake);
+	return (int64_t)GetTickCount64() - (int64_t)(awake / 10000);
+}
+
+// called with timerMutex held; SetTimer is left to the loop thread, which
+// owns the window, and KillTimer is only reached from it
+void SystemEventsManager::armTimers(bool arm) {
+	if (!hWin)
+		return;
+	if (arm)
+		PostMessage(hWin, WM_SYSTEM_EVENTS_TIMER, 0, 0);
+	else
+		KillTimer(hWin, SYSTEM_EVENTS_TIMER_ID);
 }
 #else
 io_connect_t rootPort;
 IONotificationPortRef notifyPortRef;
 io_object_t notifierObject;
+CFRunLoopRef loopRunLoop;
+CFRunLoopSourceRef wakeSource;
+CFRunLoopTimerRef wheelTimer;
 
 void systemEventCallback(void* refCon,
                          io_service_t service,
                          natural_t messageType,
                          void* messageArgument) {
-    Event event;
+    Event* event;
     switch (messageType) {
         case kIOMessageCanSystemSleep:
-            event = SystemEventsManager::getEvent(SYSTEM_SLEEP);
-
-			if (event.isPrevented()) {
-				IOCancelPowerChange(rootPort, (long)messageArgument);
-			} else {
-				if (event.isRegistered())
-					SystemEventsManager::executeCallback(event.getCallback());
-				IOAllowPowerChange(rootPort, (long)messageArgument);
-			}
+            EventTrace::instant("notify", SYSTEM_SLEEP);
+            EventCounters::add(SYSTEM_SLEEP, COUNTER_RECEIVED);
+            event = &SystemEventsManager::getEvent(SYSTEM_SLEEP);
+
+            // the method may call sleepPrevent before its deadline
+            if (!event->isPrevented())
+                SystemEventsManager::dispatchEvent(SYSTEM_SLEEP);
+
+            if (event->isPrevented()) {
+                IOCancelPowerChange(rootPort, (long)messageArgument);
+                EventTrace::instant("cancel", SYSTEM_SLEEP);
+                EventCounters::add(SYSTEM_SLEEP, COUNTER_CANCELLED);
+            } else {
+                IOAllowPowerChange(rootPort, (long)messageArgument);
+                EventTrace::instant("allow", SYSTEM_SLEEP);
+                EventCounters::add(SYSTEM_SLEEP, COUNTER_ALLOWED);
+            }
             break;
         case kIOMessageSystemWillSleep:
+            SystemEventsManager::markSleep();
             IOAllowPowerChange(rootPort, (long)messageArgument);
             break;
         case kIOMessageSystemWillPowerOn:
             break;
         case kIOMessageSystemHasPoweredOn:
-            event = SystemEventsManager::getEvent(SYSTEM_WAKE);
-            if (event.isRegistered())
-                SystemEventsManager::executeCallback(event.getCallback());
+            EventTrace::instant("notify", SYSTEM_WAKE);
+            EventCounters::add(SYSTEM_WAKE, COUNTER_RECEIVED);
+            SystemEventsManager::dispatchEvent(SYSTEM_WAKE, 1, SystemEventsManager::markWake());
             break;
         default:
             break;
     }
 }
 
+void wakeSourcePerform(void* info) {
+    CFRunLoopStop(CFRunLoopGetCurrent());
+}
+
+void wheelTimerFired(CFRunLoopTimerRef timer, void* info) {
+    SystemEventsManager::advanceTimers();
+}
+
 void SystemEventsManager::runLoop() {
     void* refCon = nullptr;
     
@@ -152,97 +269,468 @@ void SystemEventsManager::runLoop() {
                                         &notifyPortRef,
                                         systemEventCallback,
                                         &notifierObject);
-    if (rootPort != 0)
+    if (rootPort == 0) {
+        setLoopState(LOOP_STOPPED);
+        return;
+    }
+    
+    CFRunLoopSourceContext context = { 0 };
+    context.perform = wakeSourcePerform;
+    wakeSource = CFRunLoopSourceCreate(kCFAllocatorDefault, 0, &context);
+    loopRunLoop = CFRunLoopGetCurrent();
+    
+    CFRunLoopAddSource(loopRunLoop,
+                       IONotificationPortGetRunLoopSource(notifyPortRef),
+                       kCFRunLoopCommonModes);
+    CFRunLoopAddSource(loopRunLoop, wakeSource, kCFRunLoopCommonModes);
+    
     {
-        systemEventLoopRunning = true;
-        CFRunLoopAddSource(CFRunLoopGetCurrent(),
-                           IONotificationPortGetRunLoopSource(notifyPortRef),
-                           kCFRunLoopCommonModes);
+        // repeats once armed, parked in the far future while the wheel is empty
+        std::lock_guard<std::mutex> lock(timerMutex);
+        wheelTimer = CFRunLoopTimerCreate(kCFAllocatorDefault, DBL_MAX, TIMER_TICK_MS / 1000.0,
+                                          0, 0, wheelTimerFired, NULL);
+        CFRunLoopAddTimer(loopRunLoop, wheelTimer, kCFRunLoopCommonModes);
+        if (!timers.empty())
+            armTimers(true);
+    }
+    
+    setLoopState(LOOP_RUNNING);
+    while (loopState == LOOP_RUNNING)
         CFRunLoopRun();
+    
+    CFRunLoopRemoveSource(loopRunLoop, wakeSource, kCFRunLoopCommonModes);
+    CFRunLoopRemoveSource(loopRunLoop,
+                          IONotificationPortGetRunLoopSource(notifyPortRef),
+                          kCFRunLoopCommonModes);
+    CFRunLoopSourceInvalidate(wakeSource);
+    CFRelease(wakeSource);
+    
+    {
+        std::lock_guard<std::mutex> lock(timerMutex);
+        CFRunLoopTimerInvalidate(wheelTimer);
+        CFRelease(wheelTimer);
+        wheelTimer = NULL;
     }
+    
+    IODeregisterForSystemPower(&notifierObject);
+    IOServiceClose(rootPort);
+    IONotificationPortDestroy(notifyPortRef);
+}
+
+// the source stays signalled until the loop thread runs it, so a stop
+// requested before CFRunLoopRun is entered is not lost
+void SystemEventsManager::wakeLoop() {
+    CFRunLoopSourceSignal(wakeSource);
+    CFRunLoopWakeUp(loopRunLoop);
+}
+
+// the time since boot keeps counting while the machine sleeps,
+// mach_absolute_time does not; their difference only grows across a
+// suspend. mach_continuous_time needs 10.12, so the time since boot is the
+// wall clock less kern.boottime, which the kernel moves by the same amount
+// whenever the wall clock is set; a boot time that changed while the wall
+// clock was read means it was set in between, and the read is retried
+int64_t SystemEventsManager::suspendedClock() {
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0)
+        mach_timebase_info(&timebase);
+    uint64_t awake = mach_absolute_time() * timebase.numer / timebase.denom / 1000000;
+    
+    int mib[2] = { CTL_KERN, KERN_BOOTTIME };
+    struct timeval boot, check, now;
+    size_t size;
+    do {
+        size = sizeof(boot);
+        if (sysctl(mib, 2, &boot, &size, NULL, 0) != 0)
+            return -1;
+        gettimeofday(&now, NULL);
+        size = sizeof(check);
+        if (sysctl(mib, 2, &check, &size, NULL, 0) != 0)
+            return -1;
+    } while (boot.tv_sec != check.tv_sec || boot.tv_usec != check.tv_usec);
+    
+    // the two clocks start a moment apart, -1 is kept for a failed read
+    int64_t sinceBoot = ((int64_t)now.tv_sec - boot.tv_sec) * 1000 + ((int64_t)now.tv_usec - boot.tv_usec) / 1000;
+    return sinceBoot > (int64_t)awake ? sinceBoot - (int64_t)awake : 0;
+}
+
+// called with timerMutex held, from any thread
+void SystemEventsManager::armTimers(bool arm) {
+    if (!wheelTimer)
+        return;
+    CFRunLoopTimerSetNextFireDate(wheelTimer, arm ? CFAbsoluteTimeGetCurrent() + TIMER_TICK_MS / 1000.0 : DBL_MAX);
+}
+#endif
+
+void SystemEventsManager::setLoopState(int state) {
+    std::lock_guard<std::mutex> lock(loopStateMutex);
+    loopState = state;
+    loopStateChanged.notify_all();
+}
+
+int SystemEventsManager::getLoopState() {
+    return loopState;
 }
 
 void SystemEventsManager::stopLoop(bool forceStop) {
-    if (systemEventLoopRunning && (forceStop || allEventsDisabled())) {
-        CFRunLoopRemoveSource(CFRunLoopGetCurrent(),
-                              IONotificationPortGetRunLoopSource(notifyPortRef),
-                              kCFRunLoopCommonModes);
-        IODeregisterForSystemPower(&notifierObject);
-        IOServiceClose(rootPort);
-        IONotificationPortDestroy(notifyPortRef);
-        
-        CFRunLoopStop(CFRunLoopGetCurrent());
-        
-        systemEventLoopRunning = false;
+    std::lock_guard<std::mutex> lock(loopMutex);
+    if (!forceStop && !allEventsDisabled())
+        return;
+    
+    if (loopState == LOOP_RUNNING) {
+        setLoopState(LOOP_STOPPING);
+        wakeLoop();
     }
+    if (loopThread.joinable())
+        loopThread.join();
+    setLoopState(LOOP_STOPPED);
+    
+    std::lock_guard<std::mutex> subscriptionLock(subscriptionMutex);
+    reclaimSubscriptionsLocked();
+}
+
+// queues a dispatch for the callback process and returns its ticket,
+// the value consumedSequence reaches once the method has run (0 if dropped)
+uint64_t SystemEventsManager::executeCallback(int event, long callback, int parameterCount, double parameter) {
+    std::unique_lock<std::mutex> lock(completionMutex);
+    uint64_t sequence = postedSequence.load(std::memory_order_relaxed);
+    // a stuck 4D method must not hold the notification thread for good
+    if (!callbackCompleted.wait_for(lock, std::chrono::milliseconds(CALLBACK_QUEUE_TIMEOUT),
+                                    [sequence] { return sequence - consumedSequence < CALLBACK_QUEUE_SIZE; })) {
+        EventTrace::instant("overflow", event);
+        EventCounters::add(event, COUNTER_DROPPED);
+        return 0;
+    }
+    
+    CallbackItem& item = callbackQueue[sequence % CALLBACK_QUEUE_SIZE];
+    item.event = event;
+    item.methodID = callback;
+    item.postedAt = (EventTrace::isEnabled() || EventCounters::isTiming()) ? EventTrace::now() : 0;
+    item.parameterCount = parameterCount;
+    item.parameter = parameter;
+    postedSequence.store(sequence + 1);
+    lock.unlock();
+    EventCounters::add(event, COUNTER_QUEUED);
+    
+    // pairs with the park in runCallbackLoop: either the consumer sees the
+    // new sequence before sleeping or we see it parked and wake it
+    ProcessWaker::wake(callbackPark);
+    return sequence + 1;
+}
+
+// blocks the notification thread until the callback process has run the
+// method posted with ticket, or the deadline has passed
+bool SystemEventsManager::waitForCallback(int event, uint64_t ticket, unsigned int milliseconds) {
+    uint64_t begin = EventTrace::isEnabled() ? EventTrace::now() : 0;
+    std::unique_lock<std::mutex> lock(completionMutex);
+    bool completed = callbackCompleted.wait_for(lock, std::chrono::milliseconds(milliseconds),
+                                                [ticket] { return consumedSequence >= ticket; });
+    lock.unlock();
+    
+    EventTrace::span("acknowledge", event, begin);
+    if (!completed) {
+        EventTrace::instant("timeout", event);
+        EventCounters::add(event, COUNTER_TIMED_OUT);
+    }
+    return completed;
+}
+
+// brackets the use of a subscription snapshot on the notification thread,
+// see reclaimSubscriptionsLocked
+struct SubscriptionReader {
+    std::atomic<uint64_t>& epoch;
+    SubscriptionReader(std::atomic<uint64_t>& epoch) : epoch(epoch) { epoch.fetch_add(1); }
+    ~SubscriptionReader() { epoch.fetch_add(1); }
+};
+
+void SystemEventsManager::dispatchEvent(int eventID, int parameterCount, double parameter) {
+    EventRing::publish(eventID, parameterCount ? parameter : 0);
+    notifyWaiters(eventID);
+    
+    Event& event = events[eventID];
+    if (!event.isRegistered())
+        return;
+    
+    SubscriptionReader reader(subscriptionEpoch);
+    // filtered events never reach the queue or the callback process
+    Subscription* subscription = event.getSubscription();
+    if (!subscription->filter.empty() &&
+        !subscription->filter.matches(FilterContext(eventID == SYSTEM_WAKE ? parameter : -1))) {
+        EventTrace::instant("filtered", eventID);
+        EventCounters::add(eventID, COUNTER_FILTERED);
+        return;
+    }
+    
+    // trailing edge: only the last event of a burst is delivered, once the
+    // window has passed without another one
+    if (subscription->debounce) {
+        if (event.defer(parameterCount, parameter))
+            EventCounters::add(eventID, COUNTER_DEBOUNCED);
+        std::lock_guard<std::mutex> lock(timerMutex);
+        uint64_t now = currentTick();
+        timers.schedule(TIMER_DEBOUNCE | eventID, now + (subscription->debounce + TIMER_TICK_MS - 1) / TIMER_TICK_MS, now);
+        armTimers(true);
+        return;
+    }
+    
+    deliverEvent(eventID, subscription, parameterCount, parameter);
 }
-#endif
 
-void SystemEventsManager::executeCallback(long callback) {
-    callbackMethodID = callback;
-    PA_UnfreezeProcess(callbackProcessID);
+// immediate and debounced deliveries alike wait for the method, up to the
+// event's deadline
+void SystemEventsManager::deliverEvent(int eventID, Subscription* subscription, int parameterCount, double parameter) {
+    Event& event = events[eventID];
+    if (subscription->rate > 0 && !event.takeToken(subscription->rate, subscription->burst, currentMilliseconds())) {
+        EventTrace::instant("rate limited", eventID);
+        EventCounters::add(eventID, COUNTER_RATE_LIMITED);
+        return;
+    }
+    
+    uint64_t ticket = executeCallback(eventID, subscription->callback, parameterCount, parameter);
+    unsigned int deadline = event.getDeadline();
+    if (deadline)
+        waitForCallback(eventID, ticket, deadline);
+}
+
+void SystemEventsManager::flushDebounced(int eventID) {
+    Event& event = events[eventID];
+    int parameterCount;
+    double parameter;
+    if (event.takeDeferred(parameterCount, parameter) && event.isRegistered()) {
+        SubscriptionReader reader(subscriptionEpoch);
+        deliverEvent(eventID, event.getSubscription(), parameterCount, parameter);
+    }
 }
 
 void SystemEventsManager::runCallbackLoop() {
+    uint64_t consumed = consumedSequence.load(std::memory_order_relaxed);
+    unsigned int idle = 0;
     while (callbackLoopRunning) {
-        PA_YieldAbsolute();
-        PA_FreezeProcess(callbackProcessID);
-        if (callbackMethodID != 0) {
-            PA_ExecuteMethodByID(callbackMethodID, nullptr, 0);
+        // stopLoop checks for new registrations and holds under loopMutex
+        if (loopStopRequested.exchange(false))
+            stopLoop();
+        
+        // pending work is drained without going back to the host
+        if (postedSequence.load(std::memory_order_acquire) != consumed) {
+            CallbackItem item = callbackQueue[consumed % CALLBACK_QUEUE_SIZE];
+            EventTrace::span("queue", item.event, item.postedAt);
+            bool timed = item.postedAt && EventCounters::isTiming();
+            uint64_t begin = (EventTrace::isEnabled() || timed) ? EventTrace::now() : 0;
+            if (timed)
+                EventCounters::observe(item.event, HISTOGRAM_QUEUE, begin > item.postedAt ? begin - item.postedAt : 0);
+            if (item.parameterCount) {
+                PA_Variable parameter = PA_CreateVariable(eVK_Real);
+                PA_SetRealVariable(&parameter, item.parameter);
+                PA_ExecuteMethodByID(item.methodID, &parameter, 1);
+                PA_ClearVariable(&parameter);
+            } else {
+                PA_ExecuteMethodByID(item.methodID, nullptr, 0);
+            }
+            EventTrace::span("method", item.event, begin);
+            if (timed) {
+                uint64_t end = EventTrace::now();
+                EventCounters::observe(item.event, HISTOGRAM_METHOD, end > begin ? end - begin : 0);
+            }
+            EventCounters::add(item.event, COUNTER_EXECUTED);
+            
+            std::lock_guard<std::mutex> lock(completionMutex);
+            consumedSequence.store(++consumed, std::memory_order_release);
+            callbackCompleted.notify_all();
+            idle = 0;
+            continue;
+        }
+        
+        if (idle < CALLBACK_SPIN_COUNT) {
+            ++idle;
+            PA_YieldAbsolute();
+            continue;
         }
+        
+        ProcessWaker::park(callbackPark, CALLBACK_IDLE_TICKS, [consumed] {
+            return postedSequence.load() != consumed || !callbackLoopRunning || loopStopRequested;
+        });
     }
     PA_KillProcess();
 }
 
 void SystemEventsManager::prepareCallbackLoop() {
     callbackLoopRunning = true;
-    callbackProcessID = PA_NewProcess((void*)runCallbackLoop, 0, nullptr);
+    callbackPark.process = PA_NewProcess((void*)runCallbackLoop, 0, nullptr);
 }
 
 void SystemEventsManager::stopCallbackLoop() {
     callbackLoopRunning = false;
-    PA_UnfreezeProcess(callbackProcessID);
+    ProcessWaker::wake(callbackPark);
 }
 
 bool SystemEventsManager::allEventsDisabled() {
-    for (unsigned int i = 0; i < events.size(); ++i) {
+    if (waiterCount > 0)
+        return false;
+    for (unsigned int i = 0; i < SYSTEM_EVENT_COUNT; ++i) {
         if (events[i].isEnabled())
             return false;
     }
     return true;
 }
 
+void SystemEventsManager::startLoop() {
+    std::lock_guard<std::mutex> lock(loopMutex);
+    if (loopState == LOOP_STOPPED) {
+        if (loopThread.joinable())
+            loopThread.join();
+        
+        loopState = LOOP_STARTING;
+        loopThread = std::thread(runLoop);
+        
+        std::unique_lock<std::mutex> stateLock(loopStateMutex);
+        loopStateChanged.wait(stateLock, [] { return loopState != LOOP_STARTING; });
+    }
+}
+
+// the notification thread, and the callback process for the methods
 void SystemEventsManager::prepareLoop() {
-    if (allEventsDisabled()) {
-        std::thread loop(runLoop);
-        loop.detach();
+    startLoop();
+    std::lock_guard<std::mutex> lock(loopMutex);
+    if (!callbackLoopRunning)
         prepareCallbackLoop();
-    }
 }
 
 void SystemEventsManager::init() {
+    loopState = LOOP_STOPPED;
     callbackLoopRunning = false;
-    callbackMethodID = 0;
-	events.clear();
-    for (int i = 0; i < 3; ++i) {
-        events.push_back(Event());
+    loopStopRequested = false;
+    callbackPark.parked = false;
+    postedSequence = 0;
+    consumedSequence = 0;
+    nextPreventToken = 0;
+    for (unsigned int i = 0; i < SYSTEM_EVENT_COUNT; ++i) {
+        legacyPreventTokens[i] = 0;
+        delete events[i].reset();
     }
+    invalidateMethodIDs();
 }
 
 void SystemEventsManager::destroy() {
+    MetricsExporter::stop();
     stopLoop(true);
+    ProcessWaker::stop();
+    
+    // the notification thread is joined, nothing can still read a snapshot
+    std::lock_guard<std::mutex> lock(subscriptionMutex);
+    for (unsigned int i = 0; i < retiredSubscriptions.size(); ++i)
+        delete retiredSubscriptions[i].subscription;
+    retiredSubscriptions.clear();
+    for (unsigned int i = 0; i < SYSTEM_EVENT_COUNT; ++i)
+        delete events[i].reset();
+    
+    invalidateMethodIDs();
+    
+    std::lock_guard<std::mutex> preventLock(preventMutex);
+    preventTokens.clear();
 }
 
-Event SystemEventsManager::getEvent(int eventID) {
+Event& SystemEventsManager::getEvent(int eventID) {
     return events[eventID];
 }
 
-void SystemEventsManager::setCallback(int event, long methodID) {
-    events[event].setCallback(methodID);
+// unknown names are not cached, so a method created later is still found
+long SystemEventsManager::getMethodID(const CUTF16String& name) {
+    std::lock_guard<std::mutex> lock(methodIDsMutex);
+    std::map<CUTF16String, long>::iterator it = methodIDs.find(name);
+    if (it != methodIDs.end())
+        return it->second;
+    
+    long methodID = PA_GetMethodID((PA_Unichar*)name.c_str());
+    if (PA_GetLastError() != eER_NoErr || methodID <= 0)
+        return 0;
+    
+    methodIDs[name] = methodID;
+    return methodID;
+}
+
+// 4D does not notify plugins of structure changes; the cache is flushed
+// whenever a structure is opened or closed (plugin init/deinit)
+void SystemEventsManager::invalidateMethodIDs() {
+    std::lock_guard<std::mutex> lock(methodIDsMutex);
+    methodIDs.clear();
+}
+
+// the previous snapshot was swapped out before the epoch is read: if the
+// epoch is even the notification thread is between reads and will load the
+// new snapshot next, otherwise it is free once the epoch has moved on
+void SystemEventsManager::retireSubscriptionLocked(Subscription* previous) {
+    if (previous) {
+        RetiredSubscription retired = { previous, subscriptionEpoch.load() };
+        retiredSubscriptions.push_back(retired);
+    }
+    reclaimSubscriptionsLocked();
+}
+
+void SystemEventsManager::reclaimSubscriptionsLocked() {
+    uint64_t epoch = subscriptionEpoch.load();
+    size_t kept = 0;
+    for (size_t i = 0; i < retiredSubscriptions.size(); ++i) {
+        RetiredSubscription& retired = retiredSubscriptions[i];
+        if ((retired.epoch & 1) == 0 || epoch != retired.epoch)
+            delete retired.subscription;
+        else
+            retiredSubscriptions[kept++] = retired;
+    }
+    retiredSubscriptions.resize(kept);
+}
+
+int SystemEventsManager::setCallback(int event, long methodID) {
+    if (methodID <= 0)
+        return SYSTEM_EVENTS_ERR_INVALID_METHOD;
+    
+    std::lock_guard<std::mutex> lock(subscriptionMutex);
+    Subscription* previous = events[event].setCallback(methodID);
+    retireSubscriptionLocked(previous);
+    return SYSTEM_EVENTS_OK;
+}
+
+int SystemEventsManager::setCallback(int event, const CUTF16String& name) {
+    return setCallback(event, getMethodID(name));
+}
+
+int SystemEventsManager::setFilter(int event, const std::string& text) {
+    if (event < 0 || event >= SYSTEM_EVENT_COUNT)
+        return SYSTEM_EVENTS_ERR_INVALID_EVENT;
+    
+    EventFilter filter;
+    if (!filter.compile(text))
+        return SYSTEM_EVENTS_ERR_INVALID_FILTER;
+    
+    std::lock_guard<std::mutex> lock(subscriptionMutex);
+    Subscription* previous = events[event].setFilter(filter);
+    retireSubscriptionLocked(previous);
+    return SYSTEM_EVENTS_OK;
+}
+
+int SystemEventsManager::setRateLimit(int event, double rate, double burst) {
+    if (event < 0 || event >= SYSTEM_EVENT_COUNT)
+        return SYSTEM_EVENTS_ERR_INVALID_EVENT;
+    
+    std::lock_guard<std::mutex> lock(subscriptionMutex);
+    Subscription* previous = events[event].setRateLimit(rate > 0 ? rate : 0, burst);
+    retireSubscriptionLocked(previous);
+    return SYSTEM_EVENTS_OK;
+}
+
+int SystemEventsManager::setDebounce(int event, unsigned int milliseconds) {
+    if (event < 0 || event >= SYSTEM_EVENT_COUNT)
+        return SYSTEM_EVENTS_ERR_INVALID_EVENT;
+    
+    std::lock_guard<std::mutex> lock(subscriptionMutex);
+    Subscription* previous = events[event].setDebounce(milliseconds);
+    retireSubscriptionLocked(previous);
+    return SYSTEM_EVENTS_OK;
 }
 
 void SystemEventsManager::registerCallback(int event) {
     prepareLoop();
+    // reads the snapshot, which a setter on another process could retire
+    std::lock_guard<std::mutex> lock(subscriptionMutex);
     events[event].registerCallback();
 }
 
@@ -251,20 +739,265 @@ void SystemEventsManager::unregisterCallback(int event) {
     stopLoop();
 }
 
-void SystemEventsManager::prevent(int event, bool prevent) {
-	if (prevent) {
-		prepareLoop();
-#if VERSIONWIN
-		if (event == SYSTEM_SLEEP)
-			SetThreadExecutionState(ES_CONTINUOUS | ES_SYSTEM_REQUIRED);
-#endif
-	}
-    events[event].prevent(prevent);
-	if (!prevent) {
-		stopLoop();
+// the execution state belongs to the thread that sets it, so it is always
+// set on the notification thread, which stays up while any hold exists
+void SystemEventsManager::applyPrevention() {
 #if VERSIONWIN
-		if (event == SYSTEM_SLEEP)
-			SetThreadExecutionState(ES_CONTINUOUS);
+	if (hWin)
+		PostMessage(hWin, WM_SYSTEM_EVENTS_PREVENT, 0, 0);
 #endif
-	}
+}
+
+uint64_t SystemEventsManager::currentMilliseconds() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t SystemEventsManager::currentTick() {
+    return currentMilliseconds() / TIMER_TICK_MS;
+}
+
+// runs on the notification thread, which must not block on a lock held by
+// a process joining it, hence no stopLoop here: the loop stays up until the
+// next unregister or release from 4D
+void SystemEventsManager::advanceTimers() {
+    uint64_t now = currentTick();
+    std::vector<uint64_t> expired;
+    {
+        std::lock_guard<std::mutex> lock(timerMutex);
+        timers.advance(now, expired);
+        if (timers.empty())
+            armTimers(false);
+    }
+    if (expired.empty())
+        return;
+    
+    for (unsigned int i = 0; i < expired.size(); ++i) {
+        if (expired[i] & TIMER_DEBOUNCE)
+            flushDebounced((int)(expired[i] & ~TIMER_DEBOUNCE));
+    }
+    
+    bool released = false;
+    {
+        std::lock_guard<std::mutex> lock(preventMutex);
+        for (unsigned int i = 0; i < expired.size(); ++i) {
+            if (expired[i] & TIMER_DEBOUNCE)
+                continue;
+            std::map<long, PreventToken>::iterator entry = preventTokens.find((long)expired[i]);
+            // skip leases renewed after the wheel gave them up
+            if (entry == preventTokens.end() || !entry->second.expiry || entry->second.expiry > now)
+                continue;
+            EventTrace::instant("expire", entry->second.event);
+            released = releasePreventLocked(entry) || released;
+        }
+    }
+    
+    // the last hold went with its lease, and nothing else may need the loop
+    if (released && allEventsDisabled()) {
+        loopStopRequested = true;
+        ProcessWaker::wake(callbackPark);
+    }
+}
+
+long SystemEventsManager::acquirePreventLocked(int event, long process) {
+    long token = ++nextPreventToken;
+    PreventToken& entry = preventTokens[token];
+    entry.event = event;
+    entry.process = process;
+    entry.expiry = 0;
+    if (events[event].acquirePrevent())
+        applyPrevention();
+    return token;
+}
+
+// returns true when the event has no hold left; the caller then calls
+// stopLoop once preventMutex is released
+bool SystemEventsManager::releasePreventLocked(std::map<long, PreventToken>::iterator entry) {
+    int event = entry->second.event;
+    if (entry->second.expiry) {
+        std::lock_guard<std::mutex> lock(timerMutex);
+        timers.cancel((uint64_t)entry->first);
+    }
+    preventTokens.erase(entry);
+    if (!events[event].releasePrevent())
+        return false;
+    applyPrevention();
+    return true;
+}
+
+void SystemEventsManager::leasePreventLocked(long token, PreventToken& entry, unsigned int seconds) {
+    uint64_t now = currentTick();
+    entry.expiry = now + ((uint64_t)seconds * 1000 + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    std::lock_guard<std::mutex> lock(timerMutex);
+    timers.schedule((uint64_t)token, entry.expiry, now);
+    armTimers(true);
+}
+
+// sleepPrevent/sleepUnprevent share one hold per event, not owned by any process
+void SystemEventsManager::prevent(int event, bool prevent) {
+    bool released = false;
+    if (prevent)
+        prepareLoop();
+    {
+        std::lock_guard<std::mutex> lock(preventMutex);
+        long& legacyToken = legacyPreventTokens[event];
+        if (prevent && !legacyToken) {
+            legacyToken = acquirePreventLocked(event, 0);
+        } else if (!prevent && legacyToken) {
+            std::map<long, PreventToken>::iterator entry = preventTokens.find(legacyToken);
+            if (entry != preventTokens.end())
+                released = releasePreventLocked(entry);
+            legacyToken = 0;
+        }
+    }
+    if (released)
+        stopLoop();
+}
+
+long SystemEventsManager::acquirePrevent(int event, long process) {
+    prepareLoop();
+    std::lock_guard<std::mutex> lock(preventMutex);
+    return acquirePreventLocked(event, process);
+}
+
+// a lease is a token that releases itself after the given number of seconds
+// unless renewed, so a process that hangs or crashes cannot block sleep forever
+long SystemEventsManager::acquireLease(int event, long process, unsigned int seconds) {
+    prepareLoop();
+    std::lock_guard<std::mutex> lock(preventMutex);
+    long token = acquirePreventLocked(event, process);
+    leasePreventLocked(token, preventTokens[token], seconds);
+    return token;
+}
+
+int SystemEventsManager::renewLease(int event, long token, unsigned int seconds) {
+    std::lock_guard<std::mutex> lock(preventMutex);
+    std::map<long, PreventToken>::iterator entry = preventTokens.find(token);
+    if (entry == preventTokens.end() || entry->second.event != event || entry->second.process == 0)
+        return SYSTEM_EVENTS_ERR_INVALID_TOKEN;
+    leasePreventLocked(token, entry->second, seconds);
+    return SYSTEM_EVENTS_OK;
+}
+
+int SystemEventsManager::releasePrevent(int event, long token) {
+    bool released;
+    {
+        std::lock_guard<std::mutex> lock(preventMutex);
+        std::map<long, PreventToken>::iterator entry = preventTokens.find(token);
+        if (entry == preventTokens.end() || entry->second.event != event || entry->second.process == 0)
+            return SYSTEM_EVENTS_ERR_INVALID_TOKEN;
+        released = releasePreventLocked(entry);
+    }
+    if (released)
+        stopLoop();
+    return SYSTEM_EVENTS_OK;
+}
+
+// called from CloseProcess so a process that dies holding a block frees it
+void SystemEventsManager::releaseProcessPrevents(long process) {
+    bool released = false;
+    {
+        std::lock_guard<std::mutex> lock(preventMutex);
+        std::map<long, PreventToken>::iterator entry = preventTokens.begin();
+        while (entry != preventTokens.end()) {
+            std::map<long, PreventToken>::iterator current = entry++;
+            if (current->second.process == process)
+                released = releasePreventLocked(current) || released;
+        }
+    }
+    if (released)
+        stopLoop();
+}
+
+void SystemEventsManager::notifyWaiters(int eventID) {
+    if (waiterCount == 0)
+        return;
+    
+    for (unsigned int i = 0; i < WAITER_SLOTS; ++i) {
+        WaiterSlot& slot = waiters[i];
+        uint64_t state = slot.state.load(std::memory_order_acquire);
+        if ((int)(uint32_t)state != WAITER_PENDING || !(slot.mask.load(std::memory_order_relaxed) & (1u << eventID)))
+            continue;
+        if (slot.state.compare_exchange_strong(state, (state & 0xFFFFFFFF00000000ULL) | (uint32_t)eventID))
+            ProcessWaker::wake(slot.park);
+    }
+}
+
+// parks the calling process until an event in mask (bit n for event n)
+// occurs or the timeout expires, without waking in between
+int SystemEventsManager::waitForEvent(unsigned int mask, unsigned int milliseconds) {
+    WaiterSlot* slot = nullptr;
+    for (unsigned int i = 0; i < WAITER_SLOTS && !slot; ++i) {
+        bool expected = false;
+        if (waiters[i].claimed.compare_exchange_strong(expected, true))
+            slot = &waiters[i];
+    }
+    if (!slot)
+        return SYSTEM_EVENTS_WAIT_UNAVAILABLE;
+    
+    uint64_t generation = (slot->state.load(std::memory_order_relaxed) >> 32) + 1;
+    uint64_t pending = (generation << 32) | (uint32_t)WAITER_PENDING;
+    slot->mask.store(mask, std::memory_order_relaxed);
+    slot->park.process.store(PA_GetCurrentProcessNumber(), std::memory_order_relaxed);
+    ++waiterCount;
+    // only the notification thread, no method is run for a waiter
+    startLoop();
+    slot->state.store(pending, std::memory_order_release);
+    
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+    while (slot->state.load() == pending && !PA_IsProcessDying()) {
+        int64_t remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0)
+            break;
+        ProcessWaker::park(slot->park, (PA_long32)((remaining * 60 + 999) / 1000), [slot, pending] {
+            return slot->state.load() != pending;
+        });
+    }
+    
+    uint64_t settled = pending;
+    int result = SYSTEM_EVENTS_WAIT_TIMEOUT;
+    if (!slot->state.compare_exchange_strong(settled, (generation << 32) | (uint32_t)SYSTEM_EVENTS_WAIT_TIMEOUT))
+        result = (int)(uint32_t)settled;
+    
+    slot->claimed.store(false, std::memory_order_release);
+    --waiterCount;
+    stopLoop();
+    return result;
+}
+
+// the notification thread marks the point of no return before sleeping, so
+// a wake can be paired with it; a wake without a mark reports -1
+void SystemEventsManager::markSleep() {
+    sleepMark = suspendedClock();
+}
+
+// returns the seconds spent suspended since the matching sleep
+double SystemEventsManager::markWake() {
+    int64_t mark = sleepMark.exchange(-1);
+    int64_t duration = -1;
+    int64_t now = suspendedClock();
+    if (mark >= 0 && now >= 0) {
+        duration = now - mark;
+        if (duration < 0)
+            duration = 0;
+    }
+    suspendedDuration = duration;
+    return duration < 0 ? -1 : duration / 1000.0;
+}
+
+double SystemEventsManager::getSuspendedDuration() {
+    int64_t duration = suspendedDuration;
+    return duration < 0 ? -1 : duration / 1000.0;
+}
+
+int SystemEventsManager::setDeadline(int event, unsigned int milliseconds) {
+    if (event < 0 || event >= SYSTEM_EVENT_COUNT)
+        return SYSTEM_EVENTS_ERR_INVALID_EVENT;
+    if (milliseconds > SYSTEM_EVENTS_MAX_DEADLINE)
+        return SYSTEM_EVENTS_ERR_INVALID_DEADLINE;
+    
+    events[event].setDeadline(milliseconds);
+    return SYSTEM_EVENTS_OK;
 }
\ No newline at end of file
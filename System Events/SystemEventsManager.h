@@ -9,28 +9,180 @@
 #ifndef SystemEventsManager_h
 #define SystemEventsManager_h
 
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "4DPluginAPI.h"
+
 #include "Event.h"
+#include "ProcessWaker.h"
+#include "TimerWheel.h"
 
 #define SYSTEM_SLEEP 0
 #define SYSTEM_WAKE 1
 #define SYSTEM_SHUTDOWN 2
+#define SYSTEM_EVENT_COUNT 3
+
+// error codes returned to 4D
+#define SYSTEM_EVENTS_OK 0
+#define SYSTEM_EVENTS_ERR_INVALID_METHOD 1
+#define SYSTEM_EVENTS_ERR_IO 2
+#define SYSTEM_EVENTS_ERR_INVALID_EVENT 3
+#define SYSTEM_EVENTS_ERR_INVALID_TOKEN 4
+#define SYSTEM_EVENTS_ERR_INVALID_FILTER 5
+#define SYSTEM_EVENTS_ERR_INVALID_DEADLINE 6
+
+// longest a handler may hold a power notification (ms): IOKit gives up
+// on an unanswered kIOMessageCanSystemSleep after about 30 s, and Windows
+// ends an application that does not answer WM_QUERYENDSESSION in about 5 s
+#if VERSIONWIN
+#define SYSTEM_EVENTS_MAX_DEADLINE 4000
+#else
+#define SYSTEM_EVENTS_MAX_DEADLINE 25000
+#endif
+
+// state of the notification thread
+#define LOOP_STOPPED 0
+#define LOOP_STARTING 1
+#define LOOP_RUNNING 2
+#define LOOP_STOPPING 3
+
+// dispatches queued for the callback process
+#define CALLBACK_QUEUE_SIZE 64
+// how long the notification thread waits for room in a full queue (ms)
+#define CALLBACK_QUEUE_TIMEOUT 1000
+// PA_YieldAbsolute rounds before the callback process parks
+#define CALLBACK_SPIN_COUNT 8
+// the idle park of the callback process, bounded only as a last resort
+// since ProcessWaker does not lose a wake
+#define CALLBACK_IDLE_TICKS 600
+
+// resolution of the timer wheel driven by the notification thread (ms)
+#define TIMER_TICK_MS 250
+// wheel ids of lease timers are prevent tokens; debounce timers carry this
+// bit and the event number
+#define TIMER_DEBOUNCE ((uint64_t)1 << 63)
+
+// processes parked in systemEventsWait at the same time
+#define WAITER_SLOTS 32
+// results of systemEventsWait other than an event number
+#define SYSTEM_EVENTS_WAIT_TIMEOUT -1
+#define SYSTEM_EVENTS_WAIT_UNAVAILABLE -2
+
+// claimed by a waiting process, published to the notification thread by
+// storing state last. state holds the claim's generation in the high 32
+// bits and the result in the low 32; the result stays WAITER_PENDING until
+// an event or the timeout settles it, whichever wins the compare-and-swap,
+// and the generation keeps a notifier that read the slot under an earlier
+// claim from settling a later one
+#define WAITER_PENDING -3
+struct WaiterSlot {
+    std::atomic<bool> claimed;
+    std::atomic<unsigned int> mask;
+    std::atomic<uint64_t> state;
+    ProcessPark park;
+};
+
+// a sleep or shutdown hold; process is 0 for the legacy *Prevent commands,
+// expiry is the tick a lease ends on, 0 if the hold is not a lease
+struct PreventToken {
+    int event;
+    long process;
+    uint64_t expiry;
+};
+
+// a replaced subscription snapshot and the read epoch when it was replaced
+struct RetiredSubscription {
+    Subscription* subscription;
+    uint64_t epoch;
+};
+
+// parameterCount is 0 or 1, the parameter is passed to the method as a real
+struct CallbackItem {
+    int event;
+    long methodID;
+    uint64_t postedAt;
+    int parameterCount;
+    double parameter;
+};
 
 class SystemEventsManager {
 private:
-    static bool systemEventLoopRunning;
-    static bool callbackLoopRunning;
+    static std::atomic<int> loopState;
+    static std::thread loopThread;
+    static std::mutex loopMutex;
+    static std::mutex loopStateMutex;
+    static std::condition_variable loopStateChanged;
     
-    static long callbackMethodID;
-    static long callbackProcessID;
+    static std::atomic<bool> callbackLoopRunning;
+    static ProcessPark callbackPark;
+    // set by the notification thread when a lease expiry released the last
+    // hold; the callback process stops the loop, which cannot join itself
+    static std::atomic<bool> loopStopRequested;
     
-    static std::vector<Event> events;
+    static CallbackItem callbackQueue[CALLBACK_QUEUE_SIZE];
+    static std::atomic<uint64_t> postedSequence;
+    static std::atomic<uint64_t> consumedSequence;
     
+    static std::atomic<int64_t> sleepMark;
+    static std::atomic<int64_t> suspendedDuration;
+    static std::mutex completionMutex;
+    static std::condition_variable callbackCompleted;
+    
+    static Event events[SYSTEM_EVENT_COUNT];
+    
+    static std::mutex subscriptionMutex;
+    static std::vector<RetiredSubscription> retiredSubscriptions;
+    // bumped by the notification thread before and after it reads a
+    // snapshot, so it is odd while one may be in use
+    static std::atomic<uint64_t> subscriptionEpoch;
+    
+    static std::mutex methodIDsMutex;
+    static std::map<CUTF16String, long> methodIDs;
+    
+    static std::mutex preventMutex;
+    static std::map<long, PreventToken> preventTokens;
+    static long nextPreventToken;
+    static long legacyPreventTokens[SYSTEM_EVENT_COUNT];
+    
+    static std::mutex timerMutex;
+    static TimerWheel timers;
+    
+    static WaiterSlot waiters[WAITER_SLOTS];
+    static std::atomic<int> waiterCount;
+    
+    static void startLoop();
     static void prepareLoop();
     static void runLoop();
     static void stopLoop(bool = false);
+    static void wakeLoop();
+    static void setLoopState(int);
     
     static void runCallbackLoop();
     static void prepareCallbackLoop();
+    
+    static uint64_t executeCallback(int, long, int, double);
+    static bool waitForCallback(int, uint64_t, unsigned int);
+    static void deliverEvent(int, Subscription*, int, double);
+    static void retireSubscriptionLocked(Subscription*);
+    static void reclaimSubscriptionsLocked();
+    static void flushDebounced(int);
+    static void notifyWaiters(int);
+    
+    static long acquirePreventLocked(int, long);
+    static bool releasePreventLocked(std::map<long, PreventToken>::iterator);
+    static void leasePreventLocked(long, PreventToken&, unsigned int);
+    static void applyPrevention();
+    
+    static uint64_t currentMilliseconds();
+    static uint64_t currentTick();
+    static void armTimers(bool);
+    
+    static int64_t suspendedClock();
 public:
     static void init();
     static void destroy();
@@ -39,14 +191,37 @@ public:
     
     static bool allEventsDisabled();
     
-    static void executeCallback(long);
+    static int getLoopState();
+    
+    static void dispatchEvent(int, int = 0, double = 0);
     
-    static Event getEvent(int);
+    static int waitForEvent(unsigned int, unsigned int);
     
-    static void setCallback(int, long);
+    static void markSleep();
+    static double markWake();
+    static double getSuspendedDuration();
+    
+    static Event& getEvent(int);
+    
+    static long getMethodID(const CUTF16String&);
+    static void invalidateMethodIDs();
+    
+    static int setCallback(int, long);
+    static int setCallback(int, const CUTF16String&);
+    static int setFilter(int, const std::string&);
+    static int setRateLimit(int, double, double);
+    static int setDebounce(int, unsigned int);
     static void registerCallback(int);
     static void unregisterCallback(int);
     static void prevent(int, bool);
+    static long acquirePrevent(int, long);
+    static long acquireLease(int, long, unsigned int);
+    static int renewLease(int, long, unsigned int);
+    static int releasePrevent(int, long);
+    static void releaseProcessPrevents(long);
+    static int setDeadline(int, unsigned int);
+    
+    static void advanceTimers();
 };
 
 #endif /* SystemEventsManager_h */
@@ -0,0 +1,144 @@
+//
+//  TimerWheel.cpp
+//  System Events
+//
+
+#include "TimerWheel.h"
+
+TimerWheel::TimerWheel() : pending(0) {
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; ++slot) {
+            TimerNode& head = slots[level][slot];
+            head.prev = head.next = &head;
+        }
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    for (std::unordered_map<uint64_t, TimerNode*>::iterator it = nodes.begin(); it != nodes.end(); ++it)
+        delete it->second;
+}
+
+void TimerWheel::unlink(TimerNode* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = node;
+}
+
+// a timer goes on the lowest level whose span covers its distance from
+// pending, so its slot is not reached again before it is due
+void TimerWheel::insert(TimerNode* node) {
+    uint64_t expiry = node->expiry < pending ? pending : node->expiry;
+    uint64_t delta = expiry - pending;
+
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >> (TIMER_WHEEL_BITS * (level + 1)))
+        ++level;
+    if (delta >> (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+        expiry = pending + ((uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+
+    TimerNode& head = slots[level][(expiry >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK];
+    node->prev = head.prev;
+    node->next = &head;
+    head.prev->next = node;
+    head.prev = node;
+}
+
+// moves the timers of the current slot of a level down the hierarchy
+void TimerWheel::cascade(int level) {
+    TimerNode& head = slots[level][(pending >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK];
+    TimerNode* node = head.next;
+    head.prev = head.next = &head;
+    while (node != &head) {
+        TimerNode* next = node->next;
+        insert(node);
+        node = next;
+    }
+}
+
+// the first tick from pending on that expires a level 0 slot or cascades a
+// higher one: a slot of level n is reached on the ticks that are multiples
+// of 64^n and whose level n digit is its index
+uint64_t TimerWheel::nextTick() const {
+    uint64_t next = UINT64_MAX;
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        int shift = TIMER_WHEEL_BITS * level;
+        uint64_t base = (pending + (((uint64_t)1 << shift) - 1)) >> shift;
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; ++slot) {
+            const TimerNode& head = slots[level][slot];
+            if (head.next == &head)
+                continue;
+            uint64_t tick = (base + (((uint64_t)slot - base) & TIMER_WHEEL_MASK)) << shift;
+            if (tick < next)
+                next = tick;
+        }
+    }
+    return next;
+}
+
+void TimerWheel::schedule(uint64_t id, uint64_t expiry, uint64_t now) {
+    if (nodes.empty() && pending <= now)
+        pending = now + 1;
+
+    TimerNode*& node = nodes[id];
+    if (node) {
+        unlink(node);
+    } else {
+        node = new TimerNode;
+        node->id = id;
+    }
+    node->expiry = expiry;
+    insert(node);
+}
+
+bool TimerWheel::cancel(uint64_t id) {
+    std::unordered_map<uint64_t, TimerNode*>::iterator it = nodes.find(id);
+    if (it == nodes.end())
+        return false;
+    unlink(it->second);
+    delete it->second;
+    nodes.erase(it);
+    return true;
+}
+
+void TimerWheel::advance(uint64_t now, std::vector<uint64_t>& expired) {
+    while (pending <= now) {
+        if (nodes.empty()) {
+            pending = now + 1;
+            break;
+        }
+        // behind by more than a tick, as after a sleep: skip to the next
+        // tick with work instead of visiting each one
+        if (pending < now) {
+            uint64_t next = nextTick();
+            if (next > now) {
+                pending = now + 1;
+                break;
+            }
+            pending = next;
+        }
+
+        // cascade from the highest level that turns over on this tick so
+        // that timers land in lower slots before those are processed
+        int top = 0;
+        while (top < TIMER_WHEEL_LEVELS - 1 &&
+               (pending & (((uint64_t)1 << (TIMER_WHEEL_BITS * (top + 1))) - 1)) == 0)
+            ++top;
+        for (int level = top; level > 0; --level)
+            cascade(level);
+
+        TimerNode& head = slots[0][pending & TIMER_WHEEL_MASK];
+        while (head.next != &head) {
+            TimerNode* node = head.next;
+            unlink(node);
+            expired.push_back(node->id);
+            nodes.erase(node->id);
+            delete node;
+        }
+        ++pending;
+    }
+}
+
+bool TimerWheel::empty() const {
+    return nodes.empty();
+}
@@ -0,0 +1,59 @@
+//
+//  TimerWheel.h
+//  System Events
+//
+//  Hierarchical timing wheel: scheduling, cancelling and expiring a timer
+//  cost O(1); each tick costs O(1) plus the timers that fall due, and
+//  catching up after a gap jumps over the ticks with nothing to do.
+//  Not thread-safe, the owner serializes access.
+//
+
+#ifndef TimerWheel_h
+#define TimerWheel_h
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+// 64^4 ticks ahead; later timers are parked on the top level and cascaded again
+#define TIMER_WHEEL_LEVELS 4
+
+struct TimerNode {
+    uint64_t id;
+    uint64_t expiry;
+    TimerNode* prev;
+    TimerNode* next;
+};
+
+class TimerWheel {
+private:
+    // next tick advance() will process
+    uint64_t pending;
+    // sentinels of circular lists
+    TimerNode slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    std::unordered_map<uint64_t, TimerNode*> nodes;
+
+    void insert(TimerNode*);
+    void cascade(int);
+    uint64_t nextTick() const;
+    static void unlink(TimerNode*);
+
+    TimerWheel(const TimerWheel&);
+    TimerWheel& operator=(const TimerWheel&);
+public:
+    TimerWheel();
+    ~TimerWheel();
+
+    // (re)schedules id to expire at a tick; now lets an idle wheel catch up
+    void schedule(uint64_t, uint64_t, uint64_t);
+    bool cancel(uint64_t);
+    // processes the ticks up to now and appends the ids that expired
+    void advance(uint64_t, std::vector<uint64_t>&);
+
+    bool empty() const;
+};
+
+#endif /* TimerWheel_h */